@@ -0,0 +1,55 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef ARRAYSPAN_H
+#define ARRAYSPAN_H
+
+#include <cassert>
+
+using namespace std;
+
+typedef unsigned long long uint64;
+
+/*
+ * A view of size consecutive values at some address you own (a pooled
+ * allocation, a region of an mmap, a slice of a bigger array...), usable
+ * wherever the library expects a container:
+ *
+ *  float * memory = (float *) malloc(ob.bufferSize(n) * sizeof(float));
+ *  ArraySpan<float> buffer(memory, ob.bufferSize(n));
+ *  ob.computeBuffer(data, buffer);
+ *
+ * The span does not own the memory, and copying it copies the view.
+ */
+template <class DataType>
+class ArraySpan {
+  public:
+    ArraySpan() : mData(0), mArraySize(0) {}
+    ArraySpan(DataType * data, uint64 size) : mData(data), mArraySize(size) {}
+
+    inline DataType & operator[](const uint64 pos) const { assert(pos < mArraySize); return mData[pos]; }
+    inline uint64 size() const { return mArraySize; }
+    inline DataType * data() const { return mData; }
+
+    // the sub-span [begin, begin + length)
+    ArraySpan subspan(const uint64 begin, const uint64 length) const {
+      assert(begin + length <= mArraySize);
+      return ArraySpan(mData + begin, length);
+    }
+
+  protected:
+    DataType * mData;
+    uint64 mArraySize;
+};
+
+#endif
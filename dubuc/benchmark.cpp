@@ -16,6 +16,10 @@
 #include "externalarray.h"
 #include "olabuffer.h"
 #include "counted_ptr.h"
+#include "latencyhistogram.h"
+#include "olatuner.h"
+#include "rangeengines.h"
+#include "olaexecutor.h"
 
 #include <climits>
 #include <ctime>
@@ -65,7 +69,7 @@ inline double diff(rusage start,rusage end) {
 
 inline double diff( struct timeval start, struct timeval end) {
    return end.tv_sec+end.tv_usec*1e-6 -
-                  start.tv_sec+start.tv_usec*1e-6;
+                  (start.tv_sec+start.tv_usec*1e-6);
 }
    
 
@@ -94,10 +98,9 @@ void testRangeSums(int b, int N, int64 size, int MAXTRIALS=50000, bool verbose =
   VirtualArray< float, Sine<float> > data(size);
   OlaBuffer< float > ob(b,N);
   counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
-  int effectivesize = size > INT_MAX ? INT_MAX : size;
   int number = 0;
-  for(int begin = 0; begin < effectivesize; ++begin) {
-    for (int end = begin + 1 ; end <= effectivesize; ++end) {
+  for(int64 begin = 0; begin < size; ++begin) {
+    for (int64 end = begin + 1 ; end <= size; ++end) {
       if(verbose) cout << " testing range sum " << begin << " , " << end<< endl;
       RangedCubicPolynomial rcp(1,0,0,0,begin,end);
       float answer = ob.query(rcp , data , * buffer);
@@ -112,12 +115,19 @@ void testRangeSums(int b, int N, int64 size, int MAXTRIALS=50000, bool verbose =
   if(verbose) cout << " done testing range sums " << endl;
 } 
 
+// uniform over [0, size), even for sizes beyond RAND_MAX
+int64 randomIndex(const int64 size) {
+  const double unit = (double) RAND_MAX + 1.0;
+  const double u = (rand() + rand() / unit) / unit;
+  return (int64) (u * size);
+}
+
 vector<pair<int64,int64> > ranges(int MAXTRIALS, int64 size) {
     srand(423432434);
     vector<pair<int64,int64> > container;
     while(container.size() < (uint) MAXTRIALS) {
-      int64 x1 = (int64)(rand()/((double)RAND_MAX)*size) ;
-      int64 x2 = (int64)(rand()/((double)RAND_MAX)*size) ;
+      int64 x1 = randomIndex(size + 1);
+      int64 x2 = randomIndex(size + 1);
       if( x1 > x2) container.push_back(pair<int64,int64>(x2,x1));
       else container.push_back(pair<int64,int64>(x1,x2));
     }
@@ -140,6 +150,17 @@ vector<pair<int64,int64> > ranges(int MAXTRIALS, int64 size) {
   #endif
 #endif
 
+/*
+ * Set to false to get only the percentiles, and not the full histograms, 
+ * when running a configuration.
+ */
+bool dumpLatencyHistograms = true;
+
+void reportLatencies(const char * label, const LatencyHistogram & latencies) {
+  latencies.printPercentiles(cout, label);
+  if(dumpLatencyHistograms) latencies.printHistogram(cout, label);
+}
+
 
 pair<double,double> updates(int b, int N, int64 size, int MAXTRIALS=50000 , bool verbose = false) {
   if(verbose) 
@@ -152,20 +173,23 @@ pair<double,double> updates(int b, int N, int64 size, int MAXTRIALS=50000 , bool
   double Init =  diff (start,end);
   if(verbose) 
     cout << " It took " << Init<< " s to build a buffer of size " << buffer->size() << endl;
-  int effectivesize = size > INT_MAX ? INT_MAX : size;
   if(verbose) cout << " beta (number of levels) = " << ob.levels(size) << endl;
   srand(432512); // fix seed
+  LatencyHistogram latencies;
   TIMER(start);
   for(int k = 0 ; k < MAXTRIALS; ++k ) {
-    int x = (int)(rand()/((double)RAND_MAX)*effectivesize) ;
+    int64 x = randomIndex(size);
     float change = 1.0;//(rand()- RAND_MAX/2.0f)/((float)RAND_MAX); // doesn't matter
+    uint64 opstart = monotonicNanoseconds();
     ob.updateBuffer(*buffer,x, change);
+    latencies.record(monotonicNanoseconds() - opstart);
   }
   TIMER(end);
   double NombreDeSecondes =  diff(start,end);
   if(verbose) { 
     cout << " [update] Computations took " << NombreDeSecondes << endl;
     cout << " For " << MAXTRIALS << " range sums " << endl;
+    reportLatencies("update", latencies);
   }
   return pair<double,double>(Init,NombreDeSecondes);
 
@@ -222,8 +246,8 @@ pair<double,double> fastRangeSums(int b, int N, int64 size, int MAXTRIALS=50000
   double Init =  diff(start,end);
   if(verbose) 
     cout << " It took " << Init<< " s to build a buffer of size " << buffer->size() << endl;
-  int effectivesize = size > INT_MAX ? INT_MAX : size;
-  vector<pair<int64,int64> > container = ranges(MAXTRIALS, effectivesize);
+  vector<pair<int64,int64> > container = ranges(MAXTRIALS, size);
+  LatencyHistogram latencies;
   TIMER(start);
   float average = 0.0;
 #ifdef DO_PAPI
@@ -231,14 +255,16 @@ pair<double,double> fastRangeSums(int b, int N, int64 size, int MAXTRIALS=50000
 #endif 
   for(vector<pair<int64,int64> >::iterator iter = container.begin();
       iter != container.end(); ++iter) {
-      int begin = iter->first;
-      int end = iter->second;
+      int64 begin = iter->first;
+      int64 end = iter->second;
 #ifdef DO_PAPI
       cout << iter->second - iter->first << " ";
 #endif      
       maybe_start_timing();
+      uint64 opstart = monotonicNanoseconds();
       RangedCubicPolynomial rcp(1,0,0,0,begin,end);
       float answer = ob.query(rcp , data , * buffer);
+      latencies.record(monotonicNanoseconds() - opstart);
       maybe_stop_timing();
       average += answer;
   }
@@ -247,7 +273,8 @@ pair<double,double> fastRangeSums(int b, int N, int64 size, int MAXTRIALS=50000
   if(verbose) { 
     cout << " [frs] Computations took " << NombreDeSecondes << endl;
     cout << " For " << MAXTRIALS << " range sums " << endl;
-    cout << " average was " << average / MAXTRIALS << endl; 
+    cout << " average was " << average / MAXTRIALS << endl;
+    reportLatencies("frs", latencies);
   }
   return pair<double,double>(Init,NombreDeSecondes);
 }
@@ -267,8 +294,8 @@ pair<double,double> fastFirstMoments(int b, int N, int64 size, int MAXTRIALS=500
   double Init =  diff(start,end);
   if(verbose) 
     cout << " It took " << Init<< " s to build a buffer of size " << buffer->size() << endl;
-  int effectivesize = size > INT_MAX ? INT_MAX : size;
-  vector<pair<int64,int64> > container = ranges(MAXTRIALS, effectivesize);
+  vector<pair<int64,int64> > container = ranges(MAXTRIALS, size);
+  LatencyHistogram latencies;
   TIMER(start);
   float average = 0.0;
 #ifdef DO_PAPI
@@ -276,14 +303,16 @@ pair<double,double> fastFirstMoments(int b, int N, int64 size, int MAXTRIALS=500
 #endif 
   for(vector<pair<int64,int64> >::iterator iter = container.begin();
       iter != container.end(); ++iter) {
-      int begin = iter->first;
-      int end = iter->second;
+      int64 begin = iter->first;
+      int64 end = iter->second;
 #ifdef DO_PAPI
       cout << iter->second - iter->first << " ";
 #endif      
       maybe_start_timing();
+      uint64 opstart = monotonicNanoseconds();
       RangedCubicPolynomial rcp(0,1,0,0,begin,end);
       float answer = ob.query(rcp , data , * buffer);
+      latencies.record(monotonicNanoseconds() - opstart);
       maybe_stop_timing();
       average += answer;
   }
@@ -292,7 +321,8 @@ pair<double,double> fastFirstMoments(int b, int N, int64 size, int MAXTRIALS=500
   if(verbose) { 
     cout << " [ffm] Computations took " << NombreDeSecondes << endl;
     cout << " For " << MAXTRIALS << " range sums " << endl;
-    cout << " average was " << average / MAXTRIALS << endl; 
+    cout << " average was " << average / MAXTRIALS << endl;
+    reportLatencies("ffm", latencies);
   }
   return pair<double,double>(Init,NombreDeSecondes);
 }
@@ -308,9 +338,7 @@ pair<double,double> slowRangeSums(int64 size, int MAXTRIALS=50000, bool verbose
 #else
   VirtualArray< float, Sine<float> > data(size);
 #endif
-  //int effectivesize = size > INT_MAX ? INT_MAX : size;
-  int64 effectivesize = size;
-  vector<pair<int64,int64> > container = ranges(MAXTRIALS, effectivesize);
+  vector<pair<int64,int64> > container = ranges(MAXTRIALS, size);
   int64 totaltime = 0;
   float average = 0.0;
   for(vector<pair<int64,int64> >::iterator iter = container.begin();
@@ -336,9 +364,7 @@ pair<double,double> slowRangeSums(int64 size, int MAXTRIALS=50000, bool verbose
 pair<double,double> slowFirstMoments(int64 size, int MAXTRIALS=50000 , bool verbose=false) {
   if(verbose) cout << " == Slow First Moments === virtual array of size "<< size << endl;
   VirtualArray< float, Sine<float> > data(size);
-  //int effectivesize = size > INT_MAX ? INT_MAX : size;
-  int64 effectivesize = size;
-  vector<pair<int64,int64> > container = ranges(MAXTRIALS, effectivesize);
+  vector<pair<int64,int64> > container = ranges(MAXTRIALS, size);
   int64 totaltime = 0;
   float average = 0.0;
   for(vector<pair<int64,int64> >::iterator iter = container.begin();
@@ -395,6 +421,151 @@ void run(int N, int b, bool firstMomentsToo=false, int64 size =(1LL << 30)+1) {
   print(currentrow); 
 }
 
+/*
+ * Let the tuner pick b for the given memory budget and query/update mix
+ * (calibrated on this machine), then benchmark the recommendation.
+ */
+void runTuned(int N, int64 size, uint64 memoryBudget, double queryFraction, bool external) {
+  N /= 2;   // paper
+  OlaTuner<float> tuner(N);
+  tuner.calibrate();
+  OlaTuner<float>::Recommendation r = tuner.recommend(size, memoryBudget, queryFraction, external);
+  cout << " tuning for size = " << size << " budget = " << memoryBudget / (1024.0 * 1024.0) 
+    << " MB, query fraction = " << queryFraction << (external ? " (external)" : "") << endl;
+  r.print(cout);
+  OlaBuffer< float > ob(r.b,N);
+  reportParams(N,r.b,r.paddedLength,ob);
+  row currentrow;
+  if(queryFraction > 0) currentrow.push_back(fastRangeSums(r.b,N,r.paddedLength,200, true));
+  if(queryFraction < 1) currentrow.push_back(updates(r.b,N,r.paddedLength,20000, true));
+  print(currentrow);
+}
+
+// cheap to evaluate, so that memory accesses dominate
+template <class DataType>
+class Sawtooth: public unary_function<int64,DataType> {
+  public:
+    Sawtooth() {}
+    virtual ~Sawtooth(){}
+    DataType  operator()(const int64 x) const {return (DataType) (x & 1023);}
+};
+
+/*
+ * Throughput of the same random range sums one at a time and interleaved
+ * (OlaBuffer::interleavedQuery) by groups of various sizes, on a buffer
+ * meant to be larger than the last-level cache.
+ */
+void interleavedQueries(int N, int b, int64 size, int queries = 200000) {
+  N /= 2;   // paper
+  VirtualArray< float, Sawtooth<float> > data(size);
+  OlaBuffer< float > ob(b,N);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  vector<pair<int64,int64> > container = ranges(queries, size);
+  vector<RangedCubicPolynomial> rcps;
+  for(uint q = 0; q < container.size(); ++q)
+    rcps.push_back(RangedCubicPolynomial(1,0,0,0,container[q].first,container[q].second));
+  vector<RangedFunction *> functions;
+  for(uint q = 0; q < rcps.size(); ++q) functions.push_back(& rcps[q]);
+  vector<float> answers(queries);
+  cout << " interleaved queries on size = " << size << " b = " << b << " N = " << N
+    << " buffer = " << buffer->size() * sizeof(float) / (1024.0 * 1024.0) << " MB" << endl;
+  cout << " group, queries per second, speedup" << endl;
+  uint64 start = monotonicNanoseconds();
+  for(uint q = 0; q < rcps.size(); ++q) answers[q] = ob.query(rcps[q], data, *buffer);
+  const double single = queries / ((monotonicNanoseconds() - start) * 1e-9);
+  cout << "none, " << single << ", 1" << endl;
+  const int groups[] = {1, 4, 8, 16, 32, -1};
+  for(int g = 0; groups[g] > 0; ++g) {
+    start = monotonicNanoseconds();
+    ob.interleavedQuery(& functions[0], queries, data, *buffer, & answers[0], groups[g]);
+    const double throughput = queries / ((monotonicNanoseconds() - start) * 1e-9);
+    cout << groups[g] << ", " << throughput << ", " << throughput / single << endl;
+  }
+}
+
+/*
+ * Query throughput of an OlaExecutor from one thread to all the cores, on the
+ * same batch of random range sums.
+ */
+void executorScaling(int N, int b, int64 size, int queries = 200000) {
+  N /= 2;   // paper
+  VirtualArray< float, Sine<float> > data(size);
+  OlaBuffer< float > ob(b,N);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  vector<pair<int64,int64> > container = ranges(queries, size);
+  vector<RangedCubicPolynomial> rcps;
+  for(uint q = 0; q < container.size(); ++q)
+    rcps.push_back(RangedCubicPolynomial(1,0,0,0,container[q].first,container[q].second));
+  vector<RangedFunction *> functions;
+  for(uint q = 0; q < rcps.size(); ++q) functions.push_back(& rcps[q]);
+  vector<float> answers(queries);
+  cout << " executor scaling on size = " << size << " b = " << b << " N = " << N << endl;
+  cout << " threads, queries per second, speedup" << endl;
+  double single = 0.0;
+  const int cores = OlaExecutor::cores();
+  for(int threads = 1; threads <= cores; threads = (threads * 2 > cores && threads < cores) ? cores : threads * 2) {
+    OlaExecutor executor(threads);
+    OlaQueryBatch< float, VirtualArray< float, Sine<float> >, vector<float> >
+      batch(ob, & functions[0], queries, data, *buffer, & answers[0]);
+    uint64 start = monotonicNanoseconds();
+    executor.run(batch);
+    const double throughput = queries / ((monotonicNanoseconds() - start) * 1e-9);
+    if(threads == 1) single = throughput;
+    cout << threads << ", " << throughput << ", " << throughput / single << endl;
+  }
+}
+
+/*
+ * Runs the same queries and updates, on the same in-memory data, through each
+ * engine of rangeengines.h, and reports construction time, query and update
+ * latencies, memory usage and the largest discrepancy with the naive scan.
+ */
+void compareEngines(int N, int b, int64 size, int queries = 2000, int changes = 2000) {
+  N /= 2;   // paper
+  vector<float> original(size);
+  for(int64 k = 0; k < size; ++k) original[k] = sin((double) k);
+  vector<pair<int64,int64> > container = ranges(queries, size);
+  vector<int64> positions;
+  srand(432512);
+  for(int k = 0; k < changes; ++k) positions.push_back((int64)(rand()/((double)RAND_MAX)*(size - 1)));
+  vector<counted_ptr<RangeQueryEngine<float> > > engines;
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new SimdScanEngine<float>()));
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new OlaEngine<float>(b,N)));
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new FenwickEngine<float>()));
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new PrefixSumEngine<float>()));
+  vector<float> reference;
+  cout << " comparing engines on size = " << size << " b = " << b << " N = " << N << endl;
+  cout << " engine, build (s), query p50 (ns), query p99 (ns), update p50 (ns), update p99 (ns),"
+    << " memory (MB), max relative error" << endl;
+  for(uint e = 0; e < engines.size(); ++e) {
+    vector<float> data(original);
+    RangeQueryEngine<float> & engine = * engines[e];
+    uint64 start = monotonicNanoseconds();
+    engine.build(data);
+    const double buildtime = (monotonicNanoseconds() - start) * 1e-9;
+    LatencyHistogram querylatencies, updatelatencies;
+    double maxerror = 0.0;
+    for(uint q = 0; q < container.size(); ++q) {
+      RangedCubicPolynomial rcp(1,0,0,0,container[q].first,container[q].second);
+      uint64 opstart = monotonicNanoseconds();
+      float answer = engine.query(rcp);
+      querylatencies.record(monotonicNanoseconds() - opstart);
+      if(e == 0) reference.push_back(answer);
+      const double error = fabs(answer - reference[q]) / (fabs(reference[q]) + 1.0);
+      if(error > maxerror) maxerror = error;
+    }
+    for(uint u = 0; u < positions.size(); ++u) {
+      uint64 opstart = monotonicNanoseconds();
+      engine.update(positions[u], 1.0f);
+      updatelatencies.record(monotonicNanoseconds() - opstart);
+    }
+    cout << engine.name() << ", " << buildtime << ", " << querylatencies.percentile(50) << ", "
+      << querylatencies.percentile(99) << ", " << updatelatencies.percentile(50) << ", "
+      << updatelatencies.percentile(99) << ", " << engine.memoryBytes() / (1024.0 * 1024.0)
+      << ", " << maxerror << endl;
+  }
+}
+
 void runUpdates(int N, int b, int64 size =(1LL << 30)+1) {
   N /= 2;   // paper
   OlaBuffer< float > ob(b,N);
@@ -451,7 +622,11 @@ int main() {
     doUpdatesVsb = false,
     doUpdatesVsN = false,
     doNaiveSumTest = false,
-    doRepeatedb128Small = false;
+    doRepeatedb128Small = false,
+    doTuning = false,
+    doCompareEngines = false,
+    doExecutorScaling = false,
+    doInterleavedQueries = false;
 
 #ifdef USE_EXTERNAL
    doSmallerExternalTest = true;
@@ -578,6 +753,32 @@ int main() {
 
 
 
+    if (doTuning) {
+      cout << "Testing tuner recommendations for various workloads" << endl;
+      int64 smaller_n = (1LL<<28)+1;
+      double queryFractions [] = {1.0, 0.9, 0.5, 0.0, -1};
+      for(int qidx=0; queryFractions[qidx] >= 0; ++qidx)
+        runTuned(nTypical, smaller_n, 64ULL << 20, queryFractions[qidx], false);
+    }
+
+    if (doCompareEngines) {
+      cout << "Comparing Ola with the other engines (in memory)" << endl;
+      int64 smaller_n = (1LL<<24)+1;
+      for(int bidx=0; bValues[bidx] != -1; ++bidx)
+        if(bValues[bidx] < smaller_n / 8) compareEngines(nTypical, bValues[bidx], smaller_n);
+    }
+
+    if (doExecutorScaling) {
+      cout << "Batch query throughput with a thread pool, 1 to all cores" << endl;
+      executorScaling(nTypical, bTypical, (1LL<<24)+1);
+    }
+
+    if (doInterleavedQueries) {
+      cout << "Interleaved queries against a buffer larger than the cache" << endl;
+      interleavedQueries(nTypical, 16, (1LL<<28)+1);
+      interleavedQueries(nTypical, bTypical, (1LL<<30)+1);
+    }
+
     cout << "Done with benchmarking from hellifax."<<endl;
     exit(0);
 
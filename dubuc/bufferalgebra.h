@@ -0,0 +1,150 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef BUFFERALGEBRA_H
+#define BUFFERALGEBRA_H
+
+#include <vector>
+#include "arrayspan.h"
+#include "olaexecutor.h"
+
+using namespace std;
+
+/*
+ * Linear combinations of buffers, in place. The buffer is linear in the data,
+ * so that with buffers computed by the same OlaBuffer (same b and N) over data
+ * of the same length,
+ *
+ *  BufferAlgebra< float > algebra(& executor);  // or no executor: one thread
+ *  algebra.add(*total, *partition);  // total = buffer(A + B)
+ *  algebra.add(totaldata, partitiondata);  // the same on the data
+ *  ob.query(f, totaldata, *total);  // no need for computeBuffer
+ *
+ * and subtract(y, x) gives the buffer of the difference of two snapshots.
+ * Nothing here knows b or N: only the lengths are checked (they must be
+ * equal), so combining buffers of different OlaBuffers gives garbage. The
+ * operations apply to any containers, data as well as buffers.
+ *
+ * Vectors and ArraySpans are processed through pointers, in a loop the
+ * compiler can vectorize (-O3 or -ftree-vectorize); other containers go
+ * through operator[]. With an executor, the work is split in chunks of
+ * Grain values run on its threads.
+ */
+template <class DataType>
+class BufferAlgebra {
+  public:
+    enum { DefaultGrain = 1 << 16 };
+
+    // thrown when the two operands do not have the same length
+    class SizeMismatchException {
+      public: SizeMismatchException() {}
+    };
+
+    BufferAlgebra(OlaExecutor * executor = 0, const int64 Grain = DefaultGrain) :
+      mExecutor(executor), mGrain(Grain > 0 ? Grain : 1) {}
+
+    // y += a x
+    template <class Y, class X>
+    void axpy(Y & y, const DataType a, const X & x) const throw(SizeMismatchException) {
+      if((uint64) y.size() != (uint64) x.size()) throw SizeMismatchException();
+      Axpy<Y, X> op(y, a, x);
+      apply(op, y.size());
+    }
+
+    // y += x
+    template <class Y, class X>
+    void add(Y & y, const X & x) const throw(SizeMismatchException) { axpy(y, 1, x); }
+
+    // y -= x
+    template <class Y, class X>
+    void subtract(Y & y, const X & x) const throw(SizeMismatchException) { axpy(y, -1, x); }
+
+    // y *= a
+    template <class Y>
+    void scale(Y & y, const DataType a) const {
+      Scale<Y> op(y, a);
+      apply(op, y.size());
+    }
+
+  protected:
+    // the values of a container, if they are contiguous
+    static inline DataType * contiguous(vector<DataType> & v) { return v.empty() ? 0 : & v[0]; }
+    static inline const DataType * contiguous(const vector<DataType> & v) { return v.empty() ? 0 : & v[0]; }
+    static inline DataType * contiguous(const ArraySpan<DataType> & v) { return v.data(); }
+    template <class Container>
+    static inline const DataType * contiguous(const Container &) { return 0; }
+
+    static void axpy(DataType * __restrict__ y, const DataType a, const DataType * __restrict__ x, const int64 length) {
+      for(int64 k = 0; k < length; ++k) y[k] += a * x[k];
+    }
+
+    static void scale(DataType * __restrict__ y, const DataType a, const int64 length) {
+      for(int64 k = 0; k < length; ++k) y[k] *= a;
+    }
+
+    template <class Y, class X>
+    struct Axpy {
+      Axpy(Y & Target, const DataType A, const X & Source) : y(Target), a(A), x(Source) {}
+      void operator()(const int64 begin, const int64 end) const {
+        DataType * py = (DataType *) contiguous(y);
+        const DataType * px = contiguous(x);
+        if((py != 0) && (px == py)) scale(py + begin, 1 + a, end - begin);// y += a y
+        else if((py != 0) && (px != 0)) axpy(py + begin, a, px + begin, end - begin);
+        else for(int64 k = begin; k < end; ++k) y[k] += a * x[k];
+      }
+      Y & y;
+      const DataType a;
+      const X & x;
+    };
+
+    template <class Y>
+    struct Scale {
+      Scale(Y & Target, const DataType A) : y(Target), a(A) {}
+      void operator()(const int64 begin, const int64 end) const {
+        DataType * py = (DataType *) contiguous(y);
+        if(py != 0) scale(py + begin, a, end - begin);
+        else for(int64 k = begin; k < end; ++k) y[k] *= a;
+      }
+      Y & y;
+      const DataType a;
+    };
+
+    // job j is the chunk [j Grain, (j + 1) Grain)
+    template <class Op>
+    class ChunkBatch : public OlaBatch {
+      public:
+        ChunkBatch(const Op & op, const int64 length, const int64 Grain) :
+          OlaBatch((length + Grain - 1) / Grain, 1), mOp(op), mLength(length), mChunk(Grain) {}
+        virtual void execute(const int64 begin, const int64 end) {
+          mOp(begin * mChunk, end * mChunk < mLength ? end * mChunk : mLength);
+        }
+      protected:
+        const Op & mOp;
+        int64 mLength, mChunk;
+    };
+
+    template <class Op>
+    void apply(const Op & op, const int64 length) const {
+      if((mExecutor == 0) || (length <= mGrain)) {
+        op(0, length);
+        return;
+      }
+      ChunkBatch<Op> batch(op, length, mGrain);
+      mExecutor->run(batch);
+    }
+
+    OlaExecutor * mExecutor;
+    int64 mGrain;
+};
+
+#endif
@@ -0,0 +1,110 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include <vector>
+#include <cassert>
+#include "olabuffer.h"
+#include "arrayspan.h"
+
+using namespace std;
+
+/*
+ * The Ola buffers of many small series, packed one after the other in a
+ * single slab instead of one vector (and one counted_ptr) each:
+ *
+ *  OlaBuffer< float > ob(b, N);
+ *  BufferArena< float > arena(ob);
+ *  arena.build(allseries);  // one allocation for all the buffers
+ *  ob.query(f, allseries[i], arena[i]);  // arena[i] is an ArraySpan
+ *  arena.rebuild(i, allseries[i]);  // after series i changed, in place
+ *  arena.clear();  // everything at once, the slab is kept for the next build
+ *
+ * The buffers are computed in place (OlaBuffer::computeBuffer into storage),
+ * so nothing is allocated per series, and all of them share the coefficient
+ * tables of the OlaBuffer (which are themselves shared per (b, N), see
+ * DubucCoefficients). The spans returned by operator[] stay valid until the
+ * next add, build or clear; add may grow the slab (reserve first to avoid it).
+ */
+template <class DataType, class Statistics = NoOlaStatistics>
+class BufferArena {
+  public:
+    BufferArena(OlaBuffer<DataType, Statistics> & ob) : mOB(ob), mUsed(0) {}
+
+    // room for buffers totalling that many values, for that many series
+    void reserve(const int64 values, const int64 series) {
+      if((int64) mSlab.size() < values) mSlab.resize(values);
+      mOffsets.reserve(series + 1);
+    }
+
+    // computes the buffer of the series into the arena, returns its number
+    template <class Container>
+    int64 add(const Container& data) throw(typename OlaBuffer<DataType, Statistics>::TooSmallException) {
+      const int64 length = mOB.bufferSize(data.size());
+      if(mUsed + length > (int64) mSlab.size()) mSlab.resize(2 * (mUsed + length));
+      ArraySpan<DataType> buffer(& mSlab[0] + mUsed, length);
+      mOB.computeBuffer(data, buffer);
+      if(mOffsets.empty()) mOffsets.push_back(0);
+      mUsed += length;
+      mOffsets.push_back(mUsed);
+      return mOffsets.size() - 2;
+    }
+
+    // replaces the content of the arena with the buffers of all the series
+    template <class Series>
+    void build(const vector<Series>& series) throw(typename OlaBuffer<DataType, Statistics>::TooSmallException) {
+      clear();
+      int64 values = 0;
+      for(uint64 i = 0; i < series.size(); ++i) values += mOB.bufferSize(series[i].size());
+      reserve(values, series.size());
+      for(uint64 i = 0; i < series.size(); ++i) add(series[i]);
+    }
+
+    // recomputes buffer i, the series having kept its length
+    template <class Container>
+    void rebuild(const int64 i, const Container& data) throw(typename OlaBuffer<DataType, Statistics>::TooSmallException) {
+      ArraySpan<DataType> buffer = (*this)[i];
+      assert((int64) buffer.size() == mOB.bufferSize(data.size()));
+      mOB.computeBuffer(data, buffer);
+    }
+
+    inline ArraySpan<DataType> operator[](const int64 i) {
+      assert(i + 1 < (int64) mOffsets.size());
+      return ArraySpan<DataType>(& mSlab[0] + mOffsets[i], mOffsets[i + 1] - mOffsets[i]);
+    }
+
+    // number of buffers
+    inline int64 size() const { return mOffsets.empty() ? 0 : mOffsets.size() - 1; }
+
+    // values used, and allocated
+    inline int64 used() const { return mUsed; }
+    inline int64 capacity() const { return mSlab.size(); }
+
+    // forgets all the buffers, keeping the memory
+    void clear() {
+      mOffsets.clear();
+      mUsed = 0;
+    }
+
+    const OlaBuffer<DataType, Statistics> & olaBuffer() const { return mOB; }
+
+  protected:
+    OlaBuffer<DataType, Statistics> & mOB;
+    vector<DataType> mSlab;
+    vector<int64> mOffsets;// buffer i is [mOffsets[i], mOffsets[i + 1])
+    int64 mUsed;
+};
+
+#endif
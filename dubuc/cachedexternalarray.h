@@ -0,0 +1,289 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CACHEDEXTERNALARRAY_H
+#define CACHEDEXTERNALARRAY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+#include <cassert>
+
+using namespace std;
+typedef unsigned long long uint64;
+
+/*
+ * Same as ExternalArray, but instead of mapping the file it reads blocks of
+ * it with O_DIRECT into a cache of its own, of a fixed size, so that the
+ * kernel page cache plays no part: a scan (computeBuffer over the array, or
+ * over another one) cannot evict the blocks that the queries keep using,
+ * and a read costs a hit or one pread, never a page fault.
+ *
+ *  CachedExternalArray<float> data(n, "/data/sales", 256 << 20);  // 256 MB of cache
+ *  float answer = ob.query(f, data, *buffer);
+ *  cout << data.hitRatio() << " " << data.bytesRead() << endl;
+ *
+ * The cache is a 2Q (Johnson and Shasha, VLDB 1994): a block read for the
+ * first time goes to a FIFO (a quarter of the cache), and only moves to the
+ * main LRU if it is needed again after it left the FIFO, which a ghost list
+ * of recently evicted block numbers remembers. Blocks touched once by a scan
+ * thus go through the FIFO without displacing the hot set.
+ *
+ * Read through a const reference! The non-const operator[] cannot tell a
+ * read from a write, so it marks the block dirty: a scan through a non-const
+ * array writes every block it touches back to the file. The queries take the
+ * data as const, and so should your own loops:
+ *
+ *  const CachedExternalArray<float> & reader = data;
+ *  for(uint64 x = 0; x < n; ++x) sum += reader[x];
+ *
+ * Write with set(pos, value), or with the non-const operator[] where you need
+ * a reference (as computeBuffer does on a buffer). Modified blocks reach the
+ * file when they are evicted, on flush() or in the destructor (which ignores
+ * errors: call flush() first if you need to know). A reference returned by
+ * operator[] is only valid until the next access to the array, which may
+ * evict its block. The cache is not thread-safe, even for reads.
+ *
+ * BlockBytes must be a power of two, a multiple of the page size (for
+ * O_DIRECT). The file is extended to a whole number of blocks. If the file
+ * system refuses O_DIRECT (tmpfs, say), the file is opened normally and
+ * direct() is false: the cache still works, but the kernel caches too.
+ */
+template <class DataType>
+class CachedExternalArray {
+  public:
+    enum { DefaultBlockBytes = 1 << 16 };
+
+    class CannotOpenException {
+      public: CannotOpenException() {}
+    };
+
+    CachedExternalArray(const uint64 size, const string & FileName, const uint64 CacheBytes,
+        const uint64 BlockBytes = DefaultBlockBytes) throw(CannotOpenException) :
+        mArraySize(size), mFileName(FileName), mBlockBytes(BlockBytes), mBlockShift(0), mDirect(true),
+        mInSize(0), mLastBlock(~0ULL), mLastFrame(0), mHits(0), mMisses(0), mBytesRead(0), mBytesWritten(0) {
+      assert((BlockBytes & (BlockBytes - 1)) == 0);
+      assert(BlockBytes % sysconf(_SC_PAGESIZE) == 0);
+      assert(BlockBytes % sizeof(DataType) == 0);
+      while(((uint64) 1 << mBlockShift) < BlockBytes / sizeof(DataType)) ++mBlockShift;
+      mFD = ::open(FileName.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+      if((mFD == -1) && (errno == EINVAL)) {
+        mDirect = false;
+        mFD = ::open(FileName.c_str(), O_RDWR | O_CREAT, 0644);
+      }
+      if(mFD == -1) throw CannotOpenException();
+      const uint64 bytes = blocks() * mBlockBytes;
+      struct stat info;
+      if((fstat(mFD, & info) != 0) || (((uint64) info.st_size < bytes) && (ftruncate(mFD, bytes) != 0))) {
+        ::close(mFD);
+        throw CannotOpenException();
+      }
+      uint64 frames = CacheBytes / BlockBytes;
+      if(frames < 4) frames = 4;
+      if(frames > blocks()) frames = blocks() > 0 ? blocks() : 1;
+      mInCapacity = frames / 4 > 0 ? frames / 4 : 1;
+      mOutCapacity = frames / 2 > 0 ? frames / 2 : 1;
+      for(uint64 f = 0; f < frames; ++f) {
+        void * memory = 0;
+        if(posix_memalign(& memory, sysconf(_SC_PAGESIZE), BlockBytes) != 0) {
+          release();
+          throw CannotOpenException();
+        }
+        Frame frame;
+        frame.data = (DataType *) memory;
+        frame.block = ~0ULL;
+        frame.dirty = false;
+        frame.queue = Free;
+        mFrames.push_back(frame);
+        mFree.push_back(f);
+      }
+    }
+
+    virtual ~CachedExternalArray() {
+      try {
+        flush();
+      } catch(...) {}// best effort
+      release();
+    }
+
+    inline const DataType & operator[](const uint64 pos) const {
+      assert(pos < mArraySize);
+      return mFrames[frame(pos >> mBlockShift)].data[pos & ((1ULL << mBlockShift) - 1)];
+    }
+    // marks the block dirty, even if you only read (see above)
+    inline DataType & operator[](const uint64 pos) {
+      assert(pos < mArraySize);
+      Frame & f = mFrames[frame(pos >> mBlockShift)];
+      f.dirty = true;
+      return f.data[pos & ((1ULL << mBlockShift) - 1)];
+    }
+    void set(const uint64 pos, const DataType value) { (*this)[pos] = value; }
+    virtual uint64 size() const { return mArraySize; }
+
+    // writes the modified blocks to the file
+    void flush() throw(CannotOpenException) {
+      for(uint64 f = 0; f < mFrames.size(); ++f) if(mFrames[f].dirty) writeBack(f);
+    }
+
+    bool direct() const { return mDirect; }
+    uint64 blockBytes() const { return mBlockBytes; }
+    uint64 cachedBlocks() const { return mFrames.size() - mFree.size(); }
+
+    // accesses to a block that was in the cache, and to one that was not
+    // (consecutive accesses to the same block count once)
+    uint64 hits() const { return mHits; }
+    uint64 misses() const { return mMisses; }
+    double hitRatio() const { return mHits + mMisses == 0 ? 0 : mHits / (double) (mHits + mMisses); }
+    uint64 bytesRead() const { return mBytesRead; }
+    uint64 bytesWritten() const { return mBytesWritten; }
+    void resetStatistics() { mHits = mMisses = mBytesRead = mBytesWritten = 0; }
+
+  protected:
+    enum Queue { Free, In, Main };
+
+    struct Frame {
+      DataType * data;
+      uint64 block;
+      bool dirty;
+      Queue queue;
+      list<uint64>::iterator position;// in mIn or mMain
+    };
+
+    inline uint64 blocks() const { return (mArraySize * sizeof(DataType) + mBlockBytes - 1) / mBlockBytes; }
+
+    // the frame holding the block, after reading it if need be
+    inline uint64 frame(const uint64 block) const {
+      if(block == mLastBlock) return mLastFrame;
+      return lookup(block);
+    }
+
+    uint64 lookup(const uint64 block) const {
+      map<uint64, uint64>::iterator it = mTable.find(block);
+      uint64 f;
+      if(it != mTable.end()) {
+        ++mHits;
+        f = it->second;
+        if(mFrames[f].queue == Main) mMain.splice(mMain.begin(), mMain, mFrames[f].position);
+        // a hit in the FIFO does not move the block
+      } else {
+        ++mMisses;
+        f = reclaim();
+        try {
+          read(f, block);
+        } catch(...) {
+          mFree.push_back(f);
+          throw;
+        }
+        mTable[block] = f;
+        map<uint64, list<uint64>::iterator>::iterator ghost = mGhosts.find(block);
+        if(ghost != mGhosts.end()) {// seen recently: it is hot
+          mOut.erase(ghost->second);
+          mGhosts.erase(ghost);
+          mMain.push_front(f);
+          mFrames[f].queue = Main;
+          mFrames[f].position = mMain.begin();
+        } else {
+          mIn.push_front(f);
+          ++mInSize;
+          mFrames[f].queue = In;
+          mFrames[f].position = mIn.begin();
+        }
+      }
+      mLastBlock = block;
+      mLastFrame = f;
+      return f;
+    }
+
+    // a free frame, evicting a block if there is none
+    uint64 reclaim() const {
+      if(!mFree.empty()) {
+        const uint64 f = mFree.back();
+        mFree.pop_back();
+        return f;
+      }
+      const bool fromIn = (mInSize >= mInCapacity) || mMain.empty();
+      const uint64 f = fromIn ? mIn.back() : mMain.back();
+      // written back while still linked, so that nothing changes if it throws
+      if(mFrames[f].dirty) writeBack(f);
+      if(fromIn) {
+        mIn.pop_back();
+        --mInSize;
+        mOut.push_front(mFrames[f].block);
+        mGhosts[mFrames[f].block] = mOut.begin();
+        if(mGhosts.size() > mOutCapacity) {
+          mGhosts.erase(mOut.back());
+          mOut.pop_back();
+        }
+      } else {
+        mMain.pop_back();
+      }
+      mTable.erase(mFrames[f].block);
+      mFrames[f].queue = Free;
+      if(mLastBlock == mFrames[f].block) mLastBlock = ~0ULL;
+      return f;
+    }
+
+    void read(const uint64 f, const uint64 block) const throw(CannotOpenException) {
+      const ssize_t got = pread(mFD, mFrames[f].data, mBlockBytes, block * mBlockBytes);
+      if(got != (ssize_t) mBlockBytes) throw CannotOpenException();
+      mBytesRead += mBlockBytes;
+      mFrames[f].block = block;
+      mFrames[f].dirty = false;
+    }
+
+    void writeBack(const uint64 f) const throw(CannotOpenException) {
+      const ssize_t put = pwrite(mFD, mFrames[f].data, mBlockBytes, mFrames[f].block * mBlockBytes);
+      if(put != (ssize_t) mBlockBytes) throw CannotOpenException();
+      mBytesWritten += mBlockBytes;
+      mFrames[f].dirty = false;
+    }
+
+    void release() {
+      for(uint64 f = 0; f < mFrames.size(); ++f) free(mFrames[f].data);
+      mFrames.clear();
+      if(mFD != -1) ::close(mFD);
+      mFD = -1;
+    }
+
+    uint64 mArraySize;
+    string mFileName;
+    uint64 mBlockBytes;
+    int mBlockShift;// values per block = 2^mBlockShift
+    bool mDirect;
+    int mFD;
+    // the cache changes on reads too
+    mutable vector<Frame> mFrames;
+    mutable vector<uint64> mFree;
+    mutable map<uint64, uint64> mTable;// block -> frame
+    mutable list<uint64> mIn, mMain;// frames, most recent first
+    mutable list<uint64> mOut;// ghost blocks, most recent first
+    mutable map<uint64, list<uint64>::iterator> mGhosts;// block -> position in mOut
+    mutable uint64 mInSize;
+    uint64 mInCapacity, mOutCapacity;
+    mutable uint64 mLastBlock, mLastFrame;
+    mutable uint64 mHits, mMisses, mBytesRead, mBytesWritten;
+};
+
+#endif
@@ -0,0 +1,288 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cassert>
+
+using namespace std;
+typedef unsigned long long uint64;
+
+/*
+ * An array whose modified pages are known, so that it can be checkpointed
+ * incrementally (see IncrementalCheckpoint). Its memory must be contiguous.
+ */
+class Checkpointable {
+  public:
+    virtual ~Checkpointable() {}
+    virtual uint64 bytes() const = 0;
+    virtual uint64 pageBytes() const = 0;
+    // the pages modified since the last clearDirty, each listed once
+    virtual const vector<uint64> & dirtyPages() const = 0;
+    virtual void clearDirty() = 0;
+    virtual char * memory() = 0;
+};
+
+/*
+ * Wraps a contiguous container (vector, ArraySpan, ExternalArray...) and
+ * records the pages that get modified through it, which you use instead of
+ * the container wherever it may be modified:
+ *
+ *  DirtyPageArray< float > tracked(*buffer);
+ *  ob.updateBuffer(tracked, pos, change);
+ *  ob.query(f, data, *buffer);  // reads can go to the container directly
+ *
+ * Any non-const operator[] marks the page, since we cannot tell reads from
+ * writes through a reference: only use the wrapper for writing. The cost of a
+ * write is a shift and a bit test; the dirty list only grows by one entry the
+ * first time a page is written after clearDirty.
+ */
+template <class DataType, class Storage = vector<DataType> >
+class DirtyPageArray : public Checkpointable {
+  public:
+    DirtyPageArray(Storage & s, const int PageBytes = 4096) : mStorage(s), mShift(0) {
+      assert((PageBytes & (PageBytes - 1)) == 0);
+      assert(PageBytes % sizeof(DataType) == 0);
+      while((1 << mShift) < PageBytes) ++mShift;
+      mDirty.resize((pages() + 63) / 64, 0);
+    }
+    virtual ~DirtyPageArray() {}
+
+    inline const DataType & operator[](const uint64 pos) const { return mStorage[pos]; }
+    inline DataType & operator[](const uint64 pos) {
+      markPage(pos * sizeof(DataType) >> mShift);
+      return mStorage[pos];
+    }
+    inline uint64 size() const { return mStorage.size(); }
+
+    // for writes made to the container directly, marks [begin, end)
+    void markDirty(const uint64 begin, const uint64 end) {
+      if(begin >= end) return;
+      for(uint64 p = begin * sizeof(DataType) >> mShift; p <= ((end - 1) * sizeof(DataType) >> mShift); ++p)
+        markPage(p);
+    }
+
+    uint64 pages() const { return (bytes() + pageBytes() - 1) >> mShift; }
+    virtual uint64 bytes() const { return (uint64) mStorage.size() * sizeof(DataType); }
+    virtual uint64 pageBytes() const { return (uint64) 1 << mShift; }
+    virtual const vector<uint64> & dirtyPages() const { return mDirtyList; }
+    virtual void clearDirty() {
+      for(uint64 k = 0; k < mDirtyList.size(); ++k) mDirty[mDirtyList[k] >> 6] = 0;
+      mDirtyList.clear();
+    }
+    virtual char * memory() { return mStorage.size() == 0 ? 0 : (char *) & mStorage[0]; }
+
+    Storage & storage() { return mStorage; }
+
+  protected:
+    inline void markPage(const uint64 page) {
+      const uint64 bit = (uint64) 1 << (page & 63);
+      if(mDirty[page >> 6] & bit) return;
+      mDirty[page >> 6] |= bit;
+      mDirtyList.push_back(page);
+    }
+
+    Storage & mStorage;
+    int mShift;
+    vector<uint64> mDirty;// one bit per page
+    vector<uint64> mDirtyList;
+};
+
+/*
+ * Consistent snapshots of a set of arrays (typically the data and its buffer)
+ * on disk, where a checkpoint writes only the pages modified since the
+ * previous checkpoints:
+ *
+ *  IncrementalCheckpoint cp("/var/ola/sales");
+ *  cp.track(trackeddata); cp.track(trackedbuffer);
+ *  ...updates through the trackers...
+ *  cp.checkpoint();
+ *
+ * and after a restart, with arrays of the same sizes:
+ *
+ *  cp.restore();  // false if there is no checkpoint yet
+ *
+ * There are two slot files (prefix.slot0, prefix.slot1), each a full image of
+ * all the arrays (at page-aligned offsets), and a small manifest naming the
+ * slot of the last complete checkpoint. Checkpoint e writes to slot e % 2
+ * (never the one the manifest points to), which was complete at checkpoint
+ * e - 2, so it only needs the pages modified during the last two intervals;
+ * once they are synced, a new manifest is written and renamed over the old
+ * one, which is atomic. A crash at any time thus leaves the previous
+ * checkpoint intact. The first checkpoint to each slot writes everything.
+ *
+ * restore() reads each array in chunks of at most MaxRead bytes (a single
+ * read returns at most about 2 GB on Linux).
+ */
+class IncrementalCheckpoint {
+  public:
+    class CheckpointException {
+      public: CheckpointException() {}
+    };
+
+    enum { DefaultMaxRead = 1 << 30 };
+
+    IncrementalCheckpoint(const string & Prefix, const uint64 MaxRead = DefaultMaxRead) :
+        mPrefix(Prefix), mMaxRead(MaxRead), mEpoch(0) {
+      assert(MaxRead > 0);
+      mSlotEpoch[0] = mSlotEpoch[1] = 0;
+      mFD[0] = mFD[1] = -1;
+    }
+
+    virtual ~IncrementalCheckpoint() {
+      for(int s = 0; s < 2; ++s) if(mFD[s] != -1) ::close(mFD[s]);
+    }
+
+    // adds an array to the snapshots (before the first checkpoint)
+    void track(Checkpointable & array) {
+      assert(mEpoch == 0);
+      mArrays.push_back(& array);
+      mPrevious.push_back(vector<uint64>());
+    }
+
+    /*
+     * Writes a new checkpoint, clears the dirty pages of the arrays and
+     * returns the number of pages written.
+     */
+    uint64 checkpoint() throw(CheckpointException) {
+      const uint64 epoch = mEpoch + 1;
+      const int slot = epoch % 2;
+      const bool full = (mSlotEpoch[slot] == 0) || (mSlotEpoch[slot] + 2 != epoch);
+      const int fd = slotFile(slot);
+      uint64 written = 0, offset = 0;
+      for(uint64 a = 0; a < mArrays.size(); ++a) {
+        Checkpointable & array = * mArrays[a];
+        const uint64 pagebytes = array.pageBytes();
+        const uint64 pages = (array.bytes() + pagebytes - 1) / pagebytes;
+        vector<uint64> towrite;
+        if(full) {
+          for(uint64 p = 0; p < pages; ++p) towrite.push_back(p);
+        } else {
+          towrite = mPrevious[a];
+          towrite.insert(towrite.end(), array.dirtyPages().begin(), array.dirtyPages().end());
+          sort(towrite.begin(), towrite.end());
+          towrite.erase(unique(towrite.begin(), towrite.end()), towrite.end());
+        }
+        for(uint64 k = 0; k < towrite.size(); ++k) {
+          const uint64 begin = towrite[k] * pagebytes;
+          const uint64 length = begin + pagebytes > array.bytes() ? array.bytes() - begin : pagebytes;
+          if(pwrite(fd, array.memory() + begin, length, offset + begin) != (ssize_t) length)
+            throw CheckpointException();
+        }
+        written += towrite.size();
+        offset += pages * pagebytes;
+      }
+      if(fdatasync(fd) != 0) throw CheckpointException();
+      writeManifest(epoch, slot);
+      mEpoch = epoch;
+      mSlotEpoch[slot] = epoch;
+      for(uint64 a = 0; a < mArrays.size(); ++a) {
+        mPrevious[a] = mArrays[a]->dirtyPages();
+        mArrays[a]->clearDirty();
+      }
+      return written;
+    }
+
+    /*
+     * Loads the last checkpoint into the arrays, which must have the sizes
+     * they had then. Returns false if there is none (or it does not match).
+     */
+    bool restore() throw(CheckpointException) {
+      ifstream manifest((mPrefix + ".manifest").c_str());
+      uint64 epoch, arrays;
+      int slot;
+      if(!(manifest >> epoch >> slot >> arrays) || (arrays != mArrays.size()) || (slot < 0) || (slot > 1))
+        return false;
+      for(uint64 a = 0; a < arrays; ++a) {
+        uint64 bytes;
+        if(!(manifest >> bytes) || (bytes != mArrays[a]->bytes())) return false;
+      }
+      const int fd = slotFile(slot);
+      uint64 offset = 0;
+      for(uint64 a = 0; a < mArrays.size(); ++a) {
+        Checkpointable & array = * mArrays[a];
+        readAll(fd, array.memory(), array.bytes(), offset);
+        array.clearDirty();
+        mPrevious[a].clear();
+        const uint64 pagebytes = array.pageBytes();
+        offset += (array.bytes() + pagebytes - 1) / pagebytes * pagebytes;
+      }
+      // the other slot is older: the next checkpoint to it is full
+      mEpoch = epoch;
+      mSlotEpoch[slot] = epoch;
+      mSlotEpoch[1 - slot] = 0;
+      return true;
+    }
+
+    // number of the last checkpoint (0 if none)
+    uint64 epoch() const { return mEpoch; }
+
+  protected:
+    int slotFile(const int slot) throw(CheckpointException) {
+      if(mFD[slot] == -1) {
+        mFD[slot] = ::open((mPrefix + (slot == 0 ? ".slot0" : ".slot1")).c_str(), O_RDWR | O_CREAT, 0644);
+        if(mFD[slot] == -1) throw CheckpointException();
+      }
+      return mFD[slot];
+    }
+
+    // reads bytes at offset, however many reads it takes
+    void readAll(const int fd, char * memory, uint64 bytes, uint64 offset) throw(CheckpointException) {
+      while(bytes > 0) {
+        const ssize_t got = pread(fd, memory, bytes < mMaxRead ? bytes : mMaxRead, offset);
+        if((got == -1) && (errno == EINTR)) continue;
+        if(got <= 0) throw CheckpointException();
+        memory += got;
+        bytes -= got;
+        offset += got;
+      }
+    }
+
+    void writeManifest(const uint64 epoch, const int slot) throw(CheckpointException) {
+      const string name = mPrefix + ".manifest", temporary = name + ".tmp";
+      FILE * f = fopen(temporary.c_str(), "w");
+      if(f == 0) throw CheckpointException();
+      fprintf(f, "%llu %d %llu\n", epoch, slot, (uint64) mArrays.size());
+      for(uint64 a = 0; a < mArrays.size(); ++a) fprintf(f, "%llu\n", mArrays[a]->bytes());
+      const bool ok = (fflush(f) == 0) && (fsync(fileno(f)) == 0);
+      if((fclose(f) != 0) || !ok) throw CheckpointException();
+      if(rename(temporary.c_str(), name.c_str()) != 0) throw CheckpointException();
+      // the rename itself must reach the disk
+      const string::size_type slash = name.rfind('/');
+      const string directory = slash == string::npos ? string(".") : (slash == 0 ? string("/") : name.substr(0, slash));
+      const int dfd = ::open(directory.c_str(), O_RDONLY);
+      if(dfd != -1) { fsync(dfd); ::close(dfd); }
+    }
+
+    string mPrefix;
+    uint64 mMaxRead;
+    uint64 mEpoch;
+    uint64 mSlotEpoch[2];// checkpoint the slot holds (0 if none)
+    int mFD[2];
+    vector<Checkpointable *> mArrays;
+    vector<vector<uint64> > mPrevious;// pages modified in the interval before the last checkpoint
+};
+
+#endif
@@ -16,98 +16,134 @@
 
 //#include <functional>
 #include <vector>
+#include <map>
+#include <cassert>
+#include <pthread.h>
 using namespace std;
 
+typedef long long int64;
 
-
-
-
-  
-  struct function : public unary_function<int,float> {
-      virtual float operator() (const int l) const = 0;
-      virtual ~function() {}
-  };
   
-  struct top: function {
-      top(const int b, const int r) : mB(b), mR(r){}
-      inline float operator() (const int l) const {return mR / (float) mB - l;}
-      int mB, mR;
-      virtual ~top() {}			
-  };	
-
-  struct bottom: function {
-      bottom(const int m) : mM(m) {}
-      inline float operator() (const int l) const {return mM - l;}
-      int mM;
-      virtual ~bottom() {}
-  };
-
-
-
-
-
+/*
+ * The Dubuc (Lagrange) interpolation coefficients for a basis b and 2N
+ * neighbours: coefficients(m, r) for the middle of the array, where the
+ * 2N neighbours are centered, and leftCoefficients(m, r) for the first
+ * cells, where they are the first 2N ones (rightCoefficients mirrors them).
+ *
+ * They are computed once per (b, N), in double, and kept in a process-wide
+ * cache that all instances share (and that lives as long as the process), so
+ * that constructing a DubucCoefficients, and thus an OlaBuffer, is cheap after
+ * the first time. Tables are stored transposed, the 2N coefficients of a given
+ * r being contiguous (see coefficientRow and leftRow). The left boundary table
+ * covers r < N b, which is all that OlaBuffer asks for, unless it would exceed
+ * MaxTableEntries, in which case the coefficients are computed on each call.
+ */
 class DubucCoefficients {
   public:
-    DubucCoefficients (const int b , const int N ):	
-      mCoefficients(vector<vector<float> >(2 * N ,vector<float>(b,0.0f))), mN(N), mB(b) {
-        for(int r = 0; r < b; ++r)  
-          for(int m = 0; m < 2 * N; ++m ) {
-            mCoefficients[m][r] = DDCoefs(m - N + 1,r);
-          }
-    }
+    enum { MaxTableEntries = 1 << 22 };
+
+    DubucCoefficients (const int b , const int N ): mN(N), mB(b), mTables(& tables(b, N)) {}
     
     virtual ~DubucCoefficients() {}
     
-    inline float coefficients(int m, int r ) const {
+    inline double coefficients(int m, int r ) const {
         assert(m +  mN - 1 >= 0);
-        assert(m +  mN - 1 < (int) mCoefficients.size());
+        assert(m +  mN - 1 < 2 * mN);
         assert(r >= 0);
         assert(r < mB);
-        return mCoefficients[m + mN - 1][r];
+        return mTables->middle[(int64) r * 2 * mN + m + mN - 1];
     }    
 
-    inline float leftCoefficients(int m, int r) const {
+    inline double leftCoefficients(int m, int64 r) const {
+        assert(m >= 0);
+        assert(m < 2 * mN);
+        if(r < mTables->leftRows) return mTables->left[r * 2 * mN + m];
         return leftCoefs(m , r);
     }
     
-  //  inline float rightCoefficients(int m, int r) {
-   //     return leftCoefs(2 * mN - 1 - m, r);
-   // }
-     
-    //const vector<vector<float> > & getCoefficients() const {return mCoefficients;}
-    //const vector<vector<float> > & getLeftCoefficients() const {return mLeftCoefficients;}
+    inline double rightCoefficients(int m, int64 r) const {
+        return leftCoefficients(2 * mN - 1 - m, r);
+    }
+
+    // coefficients(m - N + 1, r) for m = 0..2N-1
+    inline const double * coefficientRow(int r) const { return & mTables->middle[(int64) r * 2 * mN]; }
+
+    // leftCoefficients(m, r) for m = 0..2N-1, or 0 if r is beyond the table
+    inline const double * leftRow(int64 r) const {
+        return r < mTables->leftRows ? & mTables->left[r * 2 * mN] : 0;
+    }
+
+    // number of (b, N) pairs computed so far in this process
+    static int cachedTables() {
+      pthread_mutex_lock(& cacheMutex());
+      const int answer = cache().size();
+      pthread_mutex_unlock(& cacheMutex());
+      return answer;
+    }
     
   protected:
-    vector<vector<float> > mCoefficients;
-    vector<vector<float> > mLeftCoefficients;
+    struct Tables {
+      vector<double> middle, left;
+      int64 leftRows;
+    };
 
+    typedef map<pair<int,int>, Tables *> Cache;
 
+    static Cache & cache() {
+      static Cache answer;
+      return answer;
+    }
 
-    static inline float product(const function& f, 
-        const int start, const int end, const int exclu) {
-      float total = 1.0f;
-      for(int i = start; i < exclu; ++i) 
-        total *= f(i);
-      for(int i = exclu + 1; i <= end; ++i) 
-        total *= f(i);
-      return total;
+    static pthread_mutex_t & cacheMutex() {
+      static pthread_mutex_t answer = PTHREAD_MUTEX_INITIALIZER;
+      return answer;
     }
 
-    inline float leftCoefs( const int m, const int r) const {
-      const float upper = product(top(mB,r),0,2*mN-1,m);
-      const float lower = product(bottom(m),0,2*mN-1,m);
-      return upper / lower;
+    static const Tables & tables(const int b, const int N) {
+      pthread_mutex_lock(& cacheMutex());
+      Tables * & answer = cache()[pair<int,int>(b, N)];
+      if(answer == 0) {
+        answer = new Tables();
+        DubucCoefficients builder(b, N, answer);
+        answer->middle.resize((int64) 2 * N * b);
+        for(int r = 0; r < b; ++r)  
+          for(int m = 0; m < 2 * N; ++m )
+            answer->middle[(int64) r * 2 * N + m] = builder.DDCoefs(m - N + 1,r);
+        answer->leftRows = (int64) N * b * 2 * N <= MaxTableEntries ? (int64) N * b : 0;
+        answer->left.resize(answer->leftRows * 2 * N);
+        for(int64 r = 0; r < answer->leftRows; ++r)
+          for(int m = 0; m < 2 * N; ++m )
+            answer->left[r * 2 * N + m] = builder.leftCoefs(m, r);
+      }
+      pthread_mutex_unlock(& cacheMutex());
+      return * answer;
     }
 
-    inline float DDCoefs(const int m, const int r) const {
-      const float upper = product(top(mB,r),1-mN,mN,m);
-      const float lower = product(bottom(m),1-mN,mN,m);
+    // used while filling the tables
+    DubucCoefficients (const int b , const int N, const Tables * t): mN(N), mB(b), mTables(t) {}
+
+    // Lagrange polynomial of the node m, among the nodes start..end, at r / b
+    inline double lagrange(const int m, const int64 r, const int start, const int end) const {
+      const double x = r / (double) mB;
+      double upper = 1.0, lower = 1.0;
+      for(int i = start; i <= end; ++i) {
+        if(i == m) continue;
+        upper *= x - i;
+        lower *= m - i;
+      }
       return upper / lower;
     }
 
-    int mN, mB;
+    inline double leftCoefs( const int m, const int64 r) const {
+      return lagrange(m, r, 0, 2 * mN - 1);
+    }
 
+    inline double DDCoefs(const int m, const int r) const {
+      return lagrange(m, r, 1 - mN, mN);
+    }
 
+    int mN, mB;
+    const Tables * mTables;
 };
 
 
@@ -21,6 +21,7 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <sys/mman.h>
+#include <fcntl.h>
 
 #include <cassert>
 //#include "../lemurcore/common.h"
@@ -55,14 +56,12 @@ class ExternalArray {
       if(!FileUtil::fileExists(mFileName) || 
           (FileUtil::getFileSize(mFileName) < mArraySize * sizeof(DataType)))  {
     
-        fstream FileStream( mFileName,std::ios::binary | std::ios::in | std::ios::out| std::ios::trunc);
-        assert(FileStream.is_open());
-        assert(!FileStream.fail());
-        DataType BigArray[1024];
-        memset(BigArray,0,1024*sizeof(DataType));
-        for(uint times = 0; times * 1024 < mArraySize + 1023;++times)
-          FileStream.write((char *) BigArray, sizeof(BigArray));
-        FileStream.close();
+        // a sparse file of zeroes: nothing is written
+        const int fd = ::open(mFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(fd != -1);
+        const int ok = ftruncate(fd, mArraySize * sizeof(DataType));
+        assert(ok == 0);
+        ::close(fd);
       }
       mFD = ::open(mFileName, O_RDWR | O_CREAT);
       assert(mFD != -1);
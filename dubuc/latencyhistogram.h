@@ -0,0 +1,170 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <ctime>
+
+using namespace std;
+
+typedef unsigned long long uint64;
+
+/*
+ * Nanoseconds elapsed on a monotonic clock (not affected by ntp or date changes).
+ * Only differences between two calls are meaningful.
+ */
+inline uint64 monotonicNanoseconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64) ts.tv_sec * 1000000000ULL + (uint64) ts.tv_nsec;
+}
+
+/*
+ * Log-bucketed latency histogram (in the spirit of HdrHistogram).
+ *
+ * Values below 2^precisionBits get a bucket each. Above that, every power of two
+ * is split into 2^(precisionBits-1) linear sub-buckets, so the relative error
+ * on any reported value is at most 2^-(precisionBits-1) (about 6% with the
+ * default of 5 bits). Recording is O(1) and the memory is fixed (a few KB),
+ * whatever the range of values.
+ *
+ * Typical use:
+ *
+ *  LatencyHistogram h;
+ *  uint64 t0 = monotonicNanoseconds();
+ *  ob.query(rcp, data, *buffer);
+ *  h.record(monotonicNanoseconds() - t0);
+ *  ...
+ *  h.printPercentiles(cout, "query");
+ */
+class LatencyHistogram {
+  public:
+    LatencyHistogram(const int precisionBits = 5) :
+      mBits(precisionBits), mSubBuckets(1ULL << precisionBits),
+      mCounts(bucketIndex(~0ULL, precisionBits) + 1, 0),
+      mTotal(0), mMin(~0ULL), mMax(0), mSum(0.0) {
+      assert(precisionBits > 1);
+      assert(precisionBits < 16);
+    }
+
+    void record(const uint64 value) {
+      ++mCounts[bucketIndex(value, mBits)];
+      ++mTotal;
+      mSum += value;
+      if(value < mMin) mMin = value;
+      if(value > mMax) mMax = value;
+    }
+
+    // adds all the samples of another histogram with the same precision
+    void merge(const LatencyHistogram & other) {
+      assert(other.mBits == mBits);
+      for(uint k = 0; k < mCounts.size(); ++k) mCounts[k] += other.mCounts[k];
+      mTotal += other.mTotal;
+      mSum += other.mSum;
+      if(other.mMin < mMin) mMin = other.mMin;
+      if(other.mMax > mMax) mMax = other.mMax;
+    }
+
+    void reset() {
+      for(uint k = 0; k < mCounts.size(); ++k) mCounts[k] = 0;
+      mTotal = 0; mMin = ~0ULL; mMax = 0; mSum = 0.0;
+    }
+
+    uint64 count() const { return mTotal; }
+    uint64 min() const { return mTotal == 0 ? 0 : mMin; }
+    uint64 max() const { return mMax; }
+    double mean() const { return mTotal == 0 ? 0.0 : mSum / mTotal; }
+
+    /*
+     * Smallest recorded value v such that at least p percent of the
+     * samples are <= v, up to the bucket resolution (we report the upper
+     * end of the bucket, clamped to the observed maximum).
+     */
+    uint64 percentile(const double p) const {
+      if(mTotal == 0) return 0;
+      uint64 rank = (uint64) (p / 100.0 * mTotal + 0.5);
+      if(rank < 1) rank = 1;
+      if(rank > mTotal) rank = mTotal;
+      uint64 seen = 0;
+      for(uint k = 0; k < mCounts.size(); ++k) {
+        seen += mCounts[k];
+        if(seen >= rank) {
+          const uint64 upper = bucketUpperBound(k);
+          return upper > mMax ? mMax : upper;
+        }
+      }
+      return mMax;
+    }
+
+    void printPercentiles(ostream & out, const char * label) const {
+      out << " [" << label << "] latency (ns) count = " << count()
+        << " min = " << min() << " mean = " << mean()
+        << " p50 = " << percentile(50) << " p90 = " << percentile(90)
+        << " p99 = " << percentile(99) << " p99.9 = " << percentile(99.9)
+        << " max = " << max() << endl;
+    }
+
+    // one line per non-empty bucket: lower bound, upper bound, count, cumulative fraction
+    void printHistogram(ostream & out, const char * label) const {
+      out << " [" << label << "] histogram (ns): lower upper count cumulative" << endl;
+      uint64 seen = 0;
+      for(uint k = 0; k < mCounts.size(); ++k) {
+        if(mCounts[k] == 0) continue;
+        seen += mCounts[k];
+        out << bucketLowerBound(k) << "\t" << bucketUpperBound(k) << "\t" << mCounts[k]
+          << "\t" << seen / (double) mTotal << endl;
+      }
+    }
+
+  protected:
+
+    static inline int highestBit(uint64 v) {
+      int answer = -1;
+      while(v != 0) { v >>= 1; ++answer; }
+      return answer;
+    }
+
+    static inline uint bucketIndex(const uint64 value, const int bits) {
+      const uint64 subbuckets = 1ULL << bits;
+      if(value < subbuckets) return (uint) value;
+      const int shift = highestBit(value) - (bits - 1);
+      const uint64 sub = value >> shift; // in [subbuckets/2, subbuckets)
+      return (uint) (subbuckets + (shift - 1) * (subbuckets / 2) + (sub - subbuckets / 2));
+    }
+
+    inline uint64 bucketLowerBound(const uint index) const {
+      if(index < mSubBuckets) return index;
+      const uint64 half = mSubBuckets / 2;
+      const int shift = (int) ((index - mSubBuckets) / half) + 1;
+      const uint64 sub = (index - mSubBuckets) % half + half;
+      return sub << shift;
+    }
+
+    inline uint64 bucketUpperBound(const uint index) const {
+      if(index < mSubBuckets) return index;
+      const int shift = (int) ((index - mSubBuckets) / (mSubBuckets / 2)) + 1;
+      return bucketLowerBound(index) + (1ULL << shift) - 1;
+    }
+
+    int mBits;
+    uint64 mSubBuckets;
+    vector<uint64> mCounts;
+    uint64 mTotal, mMin, mMax;
+    double mSum;
+};
+
+#endif
@@ -0,0 +1,190 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef MINMAXPYRAMID_H
+#define MINMAXPYRAMID_H
+
+#include <vector>
+#include <cassert>
+#include "counted_ptr.h"
+#include "olabuffer.h"
+
+using namespace std;
+
+/*
+ * Minimum and maximum (with their positions) of a block of the data.
+ * Ties go to the smallest index.
+ */
+template <class DataType>
+struct MinMaxCell {
+  DataType min, max;
+  int64 argmin, argmax;
+
+  static MinMaxCell empty() {
+    MinMaxCell c; c.argmin = c.argmax = -1; c.min = c.max = 0; return c;
+  }
+  static MinMaxCell single(const DataType value, const int64 index) {
+    MinMaxCell c; c.min = c.max = value; c.argmin = c.argmax = index; return c;
+  }
+  bool isEmpty() const { return argmin < 0; }
+
+  inline void merge(const MinMaxCell & o) {
+    if(o.isEmpty()) return;
+    if(isEmpty()) { *this = o; return; }
+    if((o.min < min) || ((o.min == min) && (o.argmin < argmin))) { min = o.min; argmin = o.argmin; }
+    if((o.max > max) || ((o.max == max) && (o.argmax < argmax))) { max = o.max; argmax = o.argmax; }
+  }
+};
+
+/*
+ * Range minimum/maximum/argmax with the same b-ary level structure as OlaBuffer:
+ * level l >= 1 has one cell per block of b^l consecutive data values, so that
+ * the pyramid holds about n/(b-1) cells, a query [start, end) visits at most
+ * 2(b-1) cells per level (O(b log_b n)) and a point update recomputes one
+ * block of b cells per level.
+ *
+ * Like OlaBuffer, the object itself only holds b; the pyramid is a flat array
+ * of MinMaxCell you keep alongside the Ola buffer: a vector, or an
+ * ExternalArray< MinMaxCell<float> > (or StripedExternalArray) of
+ * pyramidSize(n) cells for persistence and external memory. Any length works, so the data padded for the Ola buffer
+ * (computeRecommendedPaddedLength) serves both indexes.
+ *
+ *  MinMaxPyramid< float > mmp(b);
+ *  counted_ptr<vector<MinMaxCell<float> > > pyramid = mmp.computePyramid(data);
+ *  MinMaxCell<float> answer = mmp.query(begin, end, data, *pyramid);
+ *  data[pos] = newvalue;
+ *  mmp.update(pos, data, *pyramid);
+ */
+template <class DataType>
+class MinMaxPyramid {
+  public:
+    typedef MinMaxCell<DataType> Cell;
+
+    MinMaxPyramid(int b) : mB(b) { assert(b > 1); }
+
+    /*
+     * Number of levels above the data (the last one has a single cell). This
+     * is not OlaBuffer::levels: a pyramid level is ceil(count / b) cells, so
+     * that any length works, and it goes up to a single cell, where OlaBuffer
+     * needs a padded length and stops while 2N cells are left. The two agree
+     * on the cells of a level (one per b^l values), not on how many levels.
+     */
+    int levels(const int64 Length) const {
+      int answer = 0;
+      for(int64 count = Length; count > 1; count = (count + mB - 1) / mB) ++answer;
+      return answer;
+    }
+
+    // total number of cells over all levels
+    int64 pyramidSize(const int64 Length) const {
+      int64 answer = 0;
+      for(int64 count = Length; count > 1; ) {
+        count = (count + mB - 1) / mB;
+        answer += count;
+      }
+      return answer;
+    }
+
+    template <class Container>
+    counted_ptr<vector<Cell> > computePyramid(const Container& data) const {
+      counted_ptr<vector<Cell> > pyramid(new vector<Cell>(pyramidSize(data.size())));
+      computePyramid(data, *pyramid);
+      return pyramid;
+    }
+
+    // fills a caller-provided storage of at least pyramidSize(data.size()) cells
+    template <class Container, class Storage>
+    void computePyramid(const Container& data, Storage& pyramid) const {
+      const int64 n = data.size();
+      assert((int64) pyramid.size() >= pyramidSize(n));
+      int64 below = n, belowbase = 0, base = 0;
+      for(int level = 1; below > 1; ++level) {
+        const int64 count = (below + mB - 1) / mB;
+        for(int64 j = 0; j < count; ++j)
+          pyramid[base + j] = computeCell(level, j, below, belowbase, data, pyramid);
+        below = count; belowbase = base; base += count;
+      }
+    }
+
+    // min, max and their positions over [start, end); empty cell if start == end
+    template <class Container, class Storage>
+    Cell query(int64 start, int64 end, const Container& data, const Storage& pyramid) const {
+      assert(start >= 0); assert(end >= start); assert(end <= (int64) data.size());
+      Cell answer = Cell::empty();
+      int64 count = data.size(), base = 0;
+      for(int level = 0; start < end; ++level) {
+        for(; (start < end) && (start % mB != 0); ++start) answer.merge(value(level, start, base, data, pyramid));
+        for(; (start < end) && (end % mB != 0); ) answer.merge(value(level, --end, base, data, pyramid));
+        start /= mB; end /= mB;
+        if(level > 0) base += count;
+        count = (count + mB - 1) / mB;
+      }
+      return answer;
+    }
+
+    // to call after data[pos] has changed
+    template <class Container, class Storage>
+    void update(int64 pos, const Container& data, Storage& pyramid) const {
+      int64 below = data.size(), belowbase = 0, base = 0;
+      for(int level = 1; below > 1; ++level) {
+        const int64 count = (below + mB - 1) / mB;
+        pos /= mB;
+        pyramid[base + pos] = computeCell(level, pos, below, belowbase, data, pyramid);
+        below = count; belowbase = base; base += count;
+      }
+    }
+
+  protected:
+    // level 0 is the data, level l >= 1 starts at base in the flat pyramid
+    template <class Container, class Storage>
+    inline Cell value(const int level, const int64 j, const int64 base, const Container& data,
+        const Storage& pyramid) const {
+      if(level == 0) return Cell::single(data[j], j);
+      return pyramid[base + j];
+    }
+
+    // cell j of level from the (below) cells of the level under it
+    template <class Container, class Storage>
+    inline Cell computeCell(const int level, const int64 j, const int64 below, const int64 belowbase,
+        const Container& data, const Storage& pyramid) const {
+      Cell answer = Cell::empty();
+      for(int64 child = j * mB; (child < (j + 1) * mB) && (child < below); ++child)
+        answer.merge(value(level - 1, child, belowbase, data, pyramid));
+      return answer;
+    }
+
+    int mB;
+};
+
+/*
+ * Sum, mean, min and max over [start, end) from the Ola buffer and the
+ * min/max pyramid of the same data.
+ */
+template <class DataType>
+struct RangeSummary {
+  float sum, mean;
+  MinMaxCell<DataType> extrema;
+};
+
+template <class DataType, class Statistics, class Container, class Storage>
+RangeSummary<DataType> summarize(const int64 start, const int64 end, OlaBuffer<DataType, Statistics>& ob,
+    const MinMaxPyramid<DataType>& mmp, const Container& data, vector<DataType>& buffer, const Storage& pyramid) {
+  RangeSummary<DataType> answer;
+  RangedCubicPolynomial rcp(1,0,0,0,start,end);
+  answer.sum = ob.query(rcp, data, buffer);
+  answer.mean = end > start ? answer.sum / (end - start) : 0.0f;
+  answer.extrema = mmp.query(start, end, data, pyramid);
+  return answer;
+}
+
+#endif
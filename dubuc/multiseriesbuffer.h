@@ -0,0 +1,178 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef MULTISERIESBUFFER_H
+#define MULTISERIESBUFFER_H
+
+#include <vector>
+#include <map>
+#include <cassert>
+#include "counted_ptr.h"
+#include "olabuffer.h"
+#include "cubicpolynomial.h"
+
+using namespace std;
+
+// eight floats, for pointers that are only float-aligned
+typedef float v8sfu __attribute__ ((vector_size (32), aligned (4)));
+
+/*
+ * y[s] += w * x[s] for s < K, the inner loop of everything below.
+ */
+template <class DataType>
+inline void seriesAxpy(const double w, const DataType * x, DataType * y, const int K) {
+  for(int s = 0; s < K; ++s) y[s] += w * x[s];
+}
+
+// eight series per step (compiled to SSE or AVX depending on -march)
+template <>
+inline void seriesAxpy<float>(const double w, const float * x, float * y, const int K) {
+  const float fw = (float) w;
+  const v8sfu vw = {fw,fw,fw,fw,fw,fw,fw,fw};
+  int s = 0;
+  for(; s + 8 <= K; s += 8)
+    * (v8sfu *) (y + s) += vw * * (const v8sfu *) (x + s);
+  for(; s < K; ++s) y[s] += fw * x[s];
+}
+
+/*
+ * Ola buffers for K aligned series (sampled on the same positions), stored
+ * structure of arrays: the data and the buffer hold K consecutive values per
+ * position (data[x * K + s] is position x of series s), so that the
+ * coefficients and the cells visited, which are the same for all series, are
+ * computed once and applied to K values at a time:
+ *
+ *  MultiSeriesOlaBuffer< float > msb(b, N, K);
+ *  counted_ptr<vector<float> > buffer = msb.computeBuffer(data);  // data.size() = n K
+ *  vector<float> answers(K);
+ *  msb.query(rcp, data, *buffer, & answers[0]);  // the K queries at about the cost of one
+ *  msb.updateBuffer(*buffer, pos, & changes[0]);  // after data[pos * K + s] += changes[s]
+ *
+ * The length n must be valid for OlaBuffer(b, N) (computeRecommendedPaddedLength).
+ * The data and the buffer must be contiguous (vector, ArraySpan, ExternalArray).
+ */
+template <class DataType>
+class MultiSeriesOlaBuffer {
+  public:
+    MultiSeriesOlaBuffer(int b, int N, int K) : mB(b), mN(N), mK(K), mOB(b, N) {
+      assert(K > 0);
+    }
+
+    int series() const { return mK; }
+
+    // number of values (K per cell) in the buffer of K series of length n
+    int64 bufferSize(const int64 n) const { return mOB.bufferSize(n) * mK; }
+
+    template <class Container>
+    counted_ptr<vector<DataType> > computeBuffer(const Container& data)
+        throw(typename OlaBuffer<DataType>::TooSmallException) {
+      counted_ptr<vector<DataType> > buffer(new vector<DataType>(bufferSize(data.size() / mK)));
+      computeBuffer(data, *buffer);
+      return buffer;
+    }
+
+    // in place, into storage of at least bufferSize(n) values (see OlaBuffer::computeBuffer)
+    template <class Container, class Storage>
+    void computeBuffer(const Container& data, Storage& buffer) throw(typename OlaBuffer<DataType>::TooSmallException) {
+      const int64 n = data.size() / mK;
+      assert((int64) data.size() == n * mK);
+      assert((int64) buffer.size() >= bufferSize(n));
+      const int64 cells = mOB.bufferSize(n);
+      if(cells < 2 * mN) throw typename OlaBuffer<DataType>::TooSmallException();
+      DataType * out = & buffer[0];
+      for(int64 k = 0; k < cells * mK; ++k) out[k] = 0;
+      transformOnce(& data[0], n, out, 1, 0);
+      int level = 0;
+      for (int64 scale = mB; (mB * scale > 0) && (n / (mB * scale) + 1 >= 2 * mN); scale *= mB)
+        transformOnce(out, cells, out, scale / mB, ++level);
+    }
+
+    // answers[s] is the query of f on series s
+    template <class Container, class Buffer>
+    void query(RangedFunction& f, const Container& data, const Buffer& buffer, float * answers) const {
+      vector<DataType> sums(mK, 0);
+      Accumulator a(& data[0], & buffer[0], mK, & sums[0]);
+      mOB.traverse(f, data.size() / mK, a);
+      for(int s = 0; s < mK; ++s) answers[s] = sums[s];
+    }
+
+    // after data[pos * K + s] += changes[s] for all s
+    template <class Buffer>
+    void updateBuffer(Buffer& buffer, const int64 pos, const DataType * changes) {
+      Recorder r(buffer.size() / mK);
+      mOB.updateBuffer(r, pos, 1);
+      DataType * out = & buffer[0];
+      for(typename map<int64, DataType>::const_iterator i = r.mWeights.begin(); i != r.mWeights.end(); ++i)
+        seriesAxpy<DataType>(i->second, changes, out + i->first * mK, mK);
+    }
+
+    // after data[pos * K + s] += change for one series s
+    template <class Buffer>
+    void updateBuffer(Buffer& buffer, const int64 pos, const int s, const DataType change) {
+      Recorder r(buffer.size() / mK);
+      mOB.updateBuffer(r, pos, change);
+      for(typename map<int64, DataType>::const_iterator i = r.mWeights.begin(); i != r.mWeights.end(); ++i)
+        buffer[i->first * mK + s] += i->second;
+    }
+
+    const OlaBuffer<DataType> & olaBuffer() const { return mOB; }
+
+  protected:
+    // sums weight * (K values of the cell) for the cells of a query
+    struct Accumulator {
+      Accumulator(const DataType * data, const DataType * buffer, int K, DataType * sums) :
+        mData(data), mBuffer(buffer), mK(K), mSums(sums) {}
+      inline void operator()(const int level, const int64 cell, const float weight) {
+        seriesAxpy<DataType>(weight, (level == 0 ? mData : mBuffer) + cell * mK, mSums, mK);
+      }
+      const DataType * mData, * mBuffer;
+      int mK;
+      DataType * mSums;
+    };
+
+    // a scalar buffer that records what OlaBuffer::updateBuffer adds to its cells
+    struct Recorder {
+      Recorder(int64 cells) : mCells(cells) {}
+      DataType & operator[](const int64 cell) { return mWeights[cell]; }
+      int64 size() const { return mCells; }
+      int64 mCells;
+      map<int64, DataType> mWeights;
+    };
+
+    /*
+     * Same as OlaBuffer::transformOnce, K values at a time: input cell i is
+     * in[i * stride * K], output cell k is out[k * outstride * K], and at
+     * levels above 0 in and out are the same buffer.
+     */
+    void transformOnce(const DataType * in, const int64 length, DataType * out, const int64 stride,
+        const int level) {
+      const int64 scale = stride;
+      const int64 outstride = level == 0 ? 1 : mB * stride;
+      const int64 buffersize = length / (mB * scale) + 1;
+      const int64 last = (length - 1) / scale;
+      vector<int64> targets(2 * mN);
+      vector<double> weights(2 * mN);
+      for (int64 i = 0; i <= last; ++i) {
+        if((level > 0) && (i % mB == 0)) continue;// in place
+        const DataType * value = in + i * scale * mK;
+        const int count = mOB.contributions(i, buffersize, last, & targets[0], & weights[0]);
+        for(int m = 0; m < count; ++m)
+          seriesAxpy<DataType>(weights[m], value, out + targets[m] * outstride * mK, mK);
+      }
+    }
+
+    int mB, mN, mK;
+    OlaBuffer<DataType> mOB;
+};
+
+#endif
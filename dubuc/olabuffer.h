@@ -15,10 +15,14 @@
 #define OLABUFFER_H
 
 #include <vector>
+#include <map>
 #include <cassert>
+#include <cmath>
 #include "counted_ptr.h"
 #include "dubuccoefficients.h"
 #include "cubicpolynomial.h"
+#include "piecewisepolynomial.h"
+#include "olastatistics.h"
 #include <iostream>
 
 typedef long long int64;
@@ -48,10 +52,12 @@ using namespace std;
  *  this problem, you need to pad you data (either really so, or virtually through wrapping).
  *  A method called recommendedPaddedLength will suggest to you a total size you can use.
  *  
+ *  The optional Statistics parameter counts data reads, buffer reads, interpolations
+ *  and so on (see olastatistics.h); by default nothing is counted and it costs nothing.
  *  
  */
  
-template < class DataType>
+template < class DataType, class Statistics = NoOlaStatistics>
 class OlaBuffer {
 
   public:
@@ -82,6 +88,14 @@ class OlaBuffer {
      *
      */
     OlaBuffer(int b, int N) : mB(b), mN(N), mDC(b,N) { assert(N>0); assert(b>1); }
+
+    // counters accumulated by query, updateBuffer and computeBuffer (see olastatistics.h)
+    const Statistics & statistics() const { return mStats; }
+    Statistics & statistics() { return mStats; }// to reset them
+
+    // the b and N given to the constructor
+    int basis() const { return mB; }
+    int moments() const { return mN; }
   
     // this is thrown when a data stream is too small to be buffered, should never be thrown?
     class TooSmallException{
@@ -104,19 +118,22 @@ class OlaBuffer {
      * Using a buffer precomputed using the computeBuffer method and some data source,
      * compute the query given by the RangedFunction (the query is just the scalar product
      * of the Ranged Function with the data set). Note that for this to work, the 
-     * RangedFunction must be a polynomial of degree at most mN.
+     * RangedFunction must be a polynomial of degree at most mN. The buffer can
+     * be any storage computeBuffer wrote to (vector, ArraySpan, ExternalArray).
      *
      * This should have log_b (data.size()) in complexity.
      */
-    template <class Container>  
-    float query(RangedFunction& f, const Container& data, vector<DataType>& buffer) 
+    template <class Container, class Buffer>  
+    float query(RangedFunction& f, const Container& data, const Buffer& buffer) 
        const throw(InvalidBasisVsDataSizeException){
    //   cout << " query with " << f.mStart << " to " << f.mEnd << endl;
       assert(f.mStart >=0);
       assert(f.mEnd >= f.mStart);
-      assert((uint) f.mEnd <=  data.size());
+      assert((uint64) f.mEnd <=  (uint64) data.size());
       float sum = 0.0f;
-      int scale = 1;
+      int64 scale = 1;
+      int level = 0;
+      mStats.query();
       pair<int64,int64> begin = imperfectRange(f.mStart,scale,data.size());
       pair<int64,int64> end = imperfectRange(f.mEnd,scale,data.size());
       if(begin.second > end.first) end.first = begin.second; // overlap
@@ -129,6 +146,7 @@ class OlaBuffer {
             cout << " data["<<index<<"] = " << data[index] << endl;
             cout << endl;
         }
+        mStats.dataRead(index, sizeof(DataType));
         sum += (f(index) - interpolate(index,scale,f,data.size())) * data[index];
         if(verbose ) cout << " sum = " << sum << endl;
       }
@@ -141,13 +159,14 @@ class OlaBuffer {
             cout << " data["<<index<<"] = " << data[index] << endl;
             cout << endl;
         }
-         sum += (f(index) - interpolate(index,scale,f,data.size())) * data[index];
+        mStats.dataRead(index, sizeof(DataType));
+        sum += (f(index) - interpolate(index,scale,f,data.size())) * data[index];
         if(verbose ) cout << " sum = " << sum << endl;
       }
       if(validateRange) {
-        for(uint index = 0;  index < (uint64) data.size(); ++index) {
-          if((index >= (uint) begin.first) && (index < (uint) begin.second)) continue;
-          if((index >= (uint) end.first) && (index < (uint) end.second)) continue;
+        for(int64 index = 0;  (uint64) index < (uint64) data.size(); ++index) {
+          if((index >= begin.first) && (index < begin.second)) continue;
+          if((index >= end.first) && (index < end.second)) continue;
           if(abs(f(index) - interpolate(index,scale,f,data.size())) > 0.0001) {
             testImperfectRange(f.mStart,scale,data.size());
             testImperfectRange(f.mEnd,scale,data.size());
@@ -165,6 +184,7 @@ class OlaBuffer {
       for (scale = mB; (mB*scale > 0) &&
          ( (uint64) data.size() / ( mB * scale) + 1 >=  (uint) 2 * mN ) ; scale *= mB) {
         if(verbose) cout << "*************8 intermediate scale = " << scale << " mB = " << mB << endl;
+        ++level;
         if(data.size() % scale  != 1) throw InvalidBasisVsDataSizeException(); 
         pair<int64,int64> begin = imperfectRange(f.mStart,scale,data.size());
         pair<int64,int64> end = imperfectRange(f.mEnd,scale,data.size());
@@ -179,6 +199,7 @@ class OlaBuffer {
              cout << "f("<<index<<") = " << f(index) << endl;
              cout << endl;
           }
+          mStats.bufferRead(level);
           sum += (f(index) - interpolate(index,scale,f,data.size())) * buffer[index/mB];
           if(verbose ) cout << " sum = " << sum << endl;
         }
@@ -192,6 +213,7 @@ class OlaBuffer {
              cout << "f("<<index<<") = " << f(index) << endl;
              cout << endl;
           }
+          mStats.bufferRead(level);
           sum += (f(index) - interpolate(index,scale,f,data.size())) * buffer[index/mB];
           if(verbose ) cout << " sum = " << sum << endl;
         }
@@ -214,13 +236,250 @@ class OlaBuffer {
           cout << " b[" << index<< " / "<< mB<< " ] = " << buffer[index/mB] << endl;
           cout << " f(index) = " << f(index) << endl;
         }
+        mStats.bufferRead(level + 1);
         sum += f(index) * buffer[index/mB];
         if(verbose ) cout << " sum = " << sum << endl;
         if(verbose)  cout << endl;
       }
       return sum;
     }
-    
+
+    /*
+     * Same as above for a piecewise polynomial (each piece of degree at most 2N-1),
+     * in a single pass: at each level we read the union of the windows around its
+     * discontinuities (breakpoints between equal pieces need none) instead of
+     * walking the levels once per piece, then the top level over the whole support.
+     */
+    template <class Container, class Buffer>
+    float query(PiecewisePolynomial& f, const Container& data, const Buffer& buffer)
+       const throw(InvalidBasisVsDataSizeException){
+      assert(f.mStart >=0);
+      assert(f.mEnd >= f.mStart);
+      assert((uint64) f.mEnd <=  (uint64) data.size());
+      const int64 n = data.size();
+      const vector<int64> points = f.discontinuities();
+      float sum = 0.0f;
+      int64 scale = 1;
+      int level = 0;
+      mStats.query();
+      for(;;) {
+        if((level > 0) && (n % scale != 1)) throw InvalidBasisVsDataSizeException();
+        int64 next = 0;// windows are sorted, we skip what we have already read
+        for(uint p = 0; p < points.size(); ++p) {
+          pair<int64,int64> window = imperfectRange(points[p],scale,n);
+          for (int64 index = window.first > next ? window.first : next; index < window.second; index += scale) {
+            if(level == 0) {
+              mStats.dataRead(index, sizeof(DataType));
+              sum += (f(index) - interpolate(index,scale,f,n)) * data[index];
+            } else {
+              mStats.bufferRead(level);
+              sum += (f(index) - interpolate(index,scale,f,n)) * buffer[index/mB];
+            }
+            next = index + scale;
+          }
+        }
+        scale *= mB;
+        ++level;
+        if(!((mB*scale > 0) && (n / (mB * scale) + 1 >= 2 * mN))) break;
+      }
+      int64 blockbegin = f.mStart / scale * scale + (f.mStart % scale != 0 ? scale : 0);
+      int64 blockend = f.mEnd / scale  * scale + 1;
+      for(int64 index = blockbegin; index < blockend ; index += scale) {
+        mStats.bufferRead(level);
+        sum += f(index) * buffer[index/mB];
+      }
+      return sum;
+    }
+
+    /*
+     * Several queries over the same range [f[0]->mStart, f[0]->mEnd) in a single
+     * traversal: each data value and buffer cell is read once and used by all
+     * count functions, answers[k] being the query of f[k].
+     */
+    template <class Container, class Buffer>
+    void query(RangedFunction * const * f, const int count, const Container& data, const Buffer& buffer,
+        float * answers) const throw(InvalidBasisVsDataSizeException){
+      assert(count > 0);
+      const int64 n = data.size();
+      for(int k = 1; k < count; ++k) assert((f[k]->mStart == f[0]->mStart) && (f[k]->mEnd == f[0]->mEnd));
+      for(int k = 0; k < count; ++k) answers[k] = 0.0f;
+      mStats.query();
+      const int levels = correctionLevels(n);
+      for(int level = 0; level < levels; ++level) {
+        const int64 scale = power(level);
+        if((level > 0) && (n % scale != 1)) throw InvalidBasisVsDataSizeException();
+        pair<int64,int64> begin, end;
+        levelWindows(*f[0], scale, n, begin, end);
+        for(int w = 0; w < 2; ++w) {
+          const pair<int64,int64> & window = (w == 0) ? begin : end;
+          for (int64 index = window.first; index < window.second; index += scale) {
+            DataType value;
+            if(level == 0) {
+              mStats.dataRead(index, sizeof(DataType));
+              value = data[index];
+            } else {
+              mStats.bufferRead(level);
+              value = buffer[index/mB];
+            }
+            for(int k = 0; k < count; ++k)
+              answers[k] += ((*f[k])(index) - interpolate(index,scale,*f[k],n)) * value;
+          }
+        }
+      }
+      const int64 scale = power(levels);
+      const int64 blockbegin = f[0]->mStart / scale * scale + (f[0]->mStart % scale != 0 ? scale : 0);
+      const int64 blockend = f[0]->mEnd / scale  * scale + 1;
+      for(int64 index = blockbegin; index < blockend ; index += scale) {
+        mStats.bufferRead(levels);
+        const DataType value = buffer[index/mB];
+        for(int k = 0; k < count; ++k) answers[k] += (*f[k])(index) * value;
+      }
+    }
+
+    /*
+     * count independent queries, answers[k] being the query of f[k] (the same
+     * as query(*f[k], data, buffer)), for buffers much larger than the cache:
+     * a lone query waits for each level's cells in turn, one cache miss after
+     * the other. Here the queries go by groups of Group, level by level: after
+     * a query has done a level, it prefetches the cells of its next level and
+     * gives way to the other queries of the group, so that by the time it
+     * resumes its cells are (hopefully) in cache and the misses of the whole
+     * group overlap. All queries have the same number of levels, so they can
+     * move in lockstep. The buffer must hold its cells in memory (vector,
+     * ArraySpan...); the data windows, which are contiguous, are left to the
+     * hardware prefetcher.
+     */
+    template <class Container, class Buffer>
+    void interleavedQuery(RangedFunction * const * f, const int64 count, const Container& data,
+        const Buffer& buffer, float * answers, const int Group = 8) const throw(InvalidBasisVsDataSizeException) {
+      const int64 n = data.size();
+      const int levels = correctionLevels(n);
+      for(int level = 1; level < levels; ++level)
+        if(n % power(level) != 1) throw InvalidBasisVsDataSizeException();
+      for(int64 first = 0; first < count; first += Group) {
+        const int64 last = first + Group < count ? first + Group : count;
+        for(int64 k = first; k < last; ++k) {
+          mStats.query();
+          answers[k] = 0.0f;
+        }
+        for(int level = 0; level <= levels; ++level) {
+          for(int64 k = first; k < last; ++k) {
+            RangedFunction & g = * f[k];
+            addLevel(g, level, levels, n, data, buffer, answers[k]);
+            if(level < levels) prefetchLevel(g, level + 1, levels, buffer, n);
+          }
+        }
+      }
+    }
+
+    /*
+     * The cells a query of f reads and their weights, without reading them:
+     * visitor(level, cell, weight) is called for each of them, where cell is an
+     * index in the data if level is 0 and in the buffer otherwise. The query is
+     * the sum of weight * value over these calls, which is how you can answer it
+     * on several series at once (see multiseriesbuffer.h).
+     */
+    template <class Visitor>
+    void traverse(RangedFunction& f, const int64 n, Visitor& visitor) const
+        throw(InvalidBasisVsDataSizeException) {
+      mStats.query();
+      const int levels = correctionLevels(n);
+      for(int level = 0; level < levels; ++level) {
+        const int64 scale = power(level);
+        if((level > 0) && (n % scale != 1)) throw InvalidBasisVsDataSizeException();
+        pair<int64,int64> begin, end;
+        levelWindows(f, scale, n, begin, end);
+        for(int w = 0; w < 2; ++w) {
+          const pair<int64,int64> & window = (w == 0) ? begin : end;
+          for (int64 index = window.first; index < window.second; index += scale) {
+            if(level == 0) mStats.dataRead(index, sizeof(DataType));
+            else mStats.bufferRead(level);
+            visitor(level, level == 0 ? index : index / mB, f(index) - interpolate(index,scale,f,n));
+          }
+        }
+      }
+      const int64 scale = power(levels);
+      const int64 blockbegin = f.mStart / scale * scale + (f.mStart % scale != 0 ? scale : 0);
+      const int64 blockend = f.mEnd / scale  * scale + 1;
+      for(int64 index = blockbegin; index < blockend ; index += scale) {
+        mStats.bufferRead(levels);
+        visitor(levels, index / mB, f(index));
+      }
+    }
+
+    /*
+     * The query above is a sum of one correction per level, plus a top-level sum:
+     *
+     *  query(f) = levelCorrection(f,0,...) + ... + levelCorrection(f,L-1,...) + topLevelSum(f,...)
+     *
+     * where L = correctionLevels(n). Level 0 reads the data in the two windows
+     * around f.mStart and f.mEnd, level l >= 1 reads the buffer in the corresponding
+     * windows at scale b^l, and the top-level sum reads the buffer at scale b^L over
+     * the whole range. Each correction is the scalar product of f - (interpolation of f)
+     * with the values of its level, which is how the progressive queries (see
+     * olaprogressive.h) bound what they have not read yet.
+     */
+    int correctionLevels(const int64 n) const {
+      int answer = 1;
+      for(int64 scale = mB; (mB * scale > 0) && (n / (mB * scale) + 1 >= 2 * mN); scale *= mB)
+        ++answer;
+      return answer;
+    }
+
+    template <class Container, class Buffer>
+    float levelCorrection(RangedFunction& f, const int level, const Container& data, const Buffer& buffer) 
+       const throw(InvalidBasisVsDataSizeException) {
+      const int64 n = data.size();
+      if((level > 0) && (n % power(level) != 1)) throw InvalidBasisVsDataSizeException();
+      float sum = 0.0f;
+      addLevel(f, level, correctionLevels(n), n, data, buffer, sum);
+      return sum;
+    }
+
+    template <class Buffer>
+    float topLevelSum(RangedFunction& f, const Buffer& buffer, const int64 n) const {
+      const int level = correctionLevels(n);
+      float sum = 0.0f;
+      addLevel(f, level, level, n, buffer, buffer, sum);// the top level reads no data
+      return sum;
+    }
+
+    /*
+     * Sum of |f - interpolation of f| over the cells that levelCorrection reads at
+     * this level: |levelCorrection| <= levelResidual * max |value| at that level.
+     * Reads nothing.
+     */
+    double levelResidual(RangedFunction& f, const int level, const int64 n) const {
+      const int64 scale = power(level);
+      pair<int64,int64> begin, end;
+      levelWindows(f, scale, n, begin, end);
+      double sum = 0.0;
+      for(int w = 0; w < 2; ++w) {
+        const pair<int64,int64> & window = (w == 0) ? begin : end;
+        for (int64 index = window.first; index < window.second; index += scale)
+          sum += fabs(f(index) - interpolate(index,scale,f,n));
+      }
+      return sum;
+    }
+
+    /*
+     * For each level l < correctionLevels(n), the largest absolute value that
+     * levelCorrection can read at that level: DataBound for the data (level 0,
+     * which you know or can get from a scan) and the maximum of the buffer cells
+     * at scale b^l for l >= 1. Linear in the buffer size.
+     */
+    template <class Buffer>
+    vector<double> levelBounds(const Buffer& buffer, const double DataBound, const int64 n) const {
+      vector<double> answer(correctionLevels(n), 0.0);
+      answer[0] = DataBound;
+      for(int level = 1; level < (int) answer.size(); ++level) {
+        const int64 stride = power(level - 1);
+        for(int64 cell = 0; cell < (int64) buffer.size(); cell += stride) 
+          if(fabs(buffer[cell]) > answer[level]) answer[level] = fabs(buffer[cell]);
+      }
+      return answer;
+    }
+
     /*
      * Compute the buffer which can be used by the query method.
      * You'd do that only once as it is expensive (linear complexity).
@@ -230,43 +489,199 @@ class OlaBuffer {
      */
     template <class Container>  
     counted_ptr<vector<DataType> >  computeBuffer (Container& data ) throw ( TooSmallException ) {
+      counted_ptr<vector<DataType> > buffer (new vector<DataType>(bufferSize(data.size())));
+      computeBuffer(data, *buffer);
+      return buffer;
+    }
+
+    /*
+     * Same as above, but writes the buffer to storage you own: a vector, an
+     * ArraySpan over some memory region (see arrayspan.h), an ExternalArray...
+     * with at least bufferSize(data.size()) cells. Nothing else is allocated:
+     * each level is computed in place from the one below, so that rebuilding a
+     * large buffer needs no more memory than the buffer itself.
+     */
+    template <class Container, class Storage>
+    void computeBuffer (const Container& data, Storage& buffer) throw ( TooSmallException ) {
+      const int64 n = data.size();
+      assert((int64) buffer.size() >= bufferSize(n));
       if(verboseTransform) {
-        for(int x = 1; ((uint64) data.size() / (mB * x) + 1 >= 2); x*=mB) {
+        for(int64 x = 1; ((uint64) n / (mB * x) + 1 >= 2); x*=mB) {
           cout << " x = " << x << endl;
-          cout << "residual = "<< ((uint64) data.size() / (mB * x) + 1) << endl; 
+          cout << "residual = "<< ((uint64) n / (mB * x) + 1) << endl; 
         }
       }
-      int scale = 1;
-      counted_ptr<vector<DataType> > buffer = transformOnce(data,scale);
+      transformOnce(data, n, buffer, 1, 0);
+      transformUpperLevels(buffer, n);
       if(verboseTransform) {
-        for (uint k = 0; k < buffer->size();++k) cout << " 1buf["<<k<<"] = "<< (* buffer)[k]<< " ";
+        for (int64 k = 0; k < bufferSize(n); ++k) cout << " buf["<<k<<"] = "<< buffer[k]<< " ";
         cout << endl;
       }
-      for (scale = mB ; 
-          (mB*scale > 0 ) && ((uint64) data.size() / (mB * scale) + 1 >= (uint) 2 * mN); scale *= mB) {
-        if(verboseTransform) cout << " data.size() = " << data.size() 
-          << " scale = " << scale << " mN = "<< mN << endl;
-        counted_ptr<vector<DataType> > newbuffer  = transformOnce(*buffer, scale / mB);
-        if(verboseTransform) {
-          for (uint k = 0; k < newbuffer->size();++k) 
-            cout << " new buf["<<k<<"] = "<< (* newbuffer)[k]<< " ";
-          cout << endl;
+    }
+
+    /*
+     * Same as computeBuffer for data of length n that is zero but for the
+     * given (index, value) pairs, sorted by index (see sparsearray.h), in
+     * O(nonzeros levels 2N log) time instead of O(n): each level only visits
+     * the nonzero cells of the level below. The buffer must be zero to begin
+     * with (a new SparseBuffer is); only the cells that depend on some nonzero
+     * value are written.
+     */
+    template <class Storage>
+    void computeSparseBuffer(const vector<pair<int64, DataType> >& entries, const int64 n, Storage& buffer)
+        throw ( TooSmallException ) {
+      assert((int64) buffer.size() >= bufferSize(n));
+      if(bufferSize(n) < 2 * mN) throw TooSmallException();
+      vector<int64> targets(2 * mN);
+      vector<double> weights(2 * mN);
+      map<int64, double> inputs, outputs;
+      for(uint64 e = 0; e < entries.size(); ++e) {
+        assert((e == 0) || (entries[e - 1].first < entries[e].first));
+        if(entries[e].second != 0) inputs[entries[e].first] = entries[e].second;
+      }
+      const int levels = correctionLevels(n);
+      for(int level = 0; level < levels; ++level) {
+        const int64 stride = level == 0 ? 1 : power(level - 1);
+        const int64 outstride = power(level);
+        const int64 length = level == 0 ? n : bufferSize(n);
+        const int64 last = (length - 1) / stride;
+        const int64 buffersize = length / (mB * stride) + 1;
+        outputs.clear();
+        for(map<int64, double>::const_iterator it = inputs.begin(); it != inputs.end(); ++it) {
+          mStats.transformCell(level);
+          const int count = contributions(it->first, buffersize, last, & targets[0], & weights[0]);
+          for(int m = 0; m < count; ++m) outputs[targets[m]] += weights[m] * it->second;
         }
-        for (uint k = 0; k < newbuffer->size();++k) (* buffer)[k * scale ] = (* newbuffer)[k];
-        if(verboseTransform) {
-          for (uint k = 0; k < buffer->size();++k) cout << " buf["<<k<<"] = "<< (* buffer)[k]<< " ";
-          cout << endl;
+        // the outputs include the inputs that stay in place
+        for(map<int64, double>::const_iterator it = outputs.begin(); it != outputs.end(); ++it)
+          buffer[it->first * outstride] = it->second;
+        inputs.swap(outputs);
+      }
+    }
+
+    // number of cells in the buffer of an array of length n
+    inline int64 bufferSize(const int64 n) const { return n / mB + 1; }
+
+    // thrown by rebaseBuffer when b is not a power of the basis of the source
+    class NotNestedException {
+      public: NotNestedException() {}
+    };
+
+    /*
+     * Computes the buffer of the data for this basis B = b^k (k >= 1) from the
+     * buffer of the same data for basis b (source, with the same N), reading
+     * little or none of the data:
+     *
+     *  OlaBuffer< float > small(16, 2), large(16 * 16, 2);
+     *  vector<float> newbuffer(large.bufferSize(n));
+     *  large.rebaseBuffer(small, *buffer, data, newbuffer);
+     *
+     * The levels of the b buffer are undone, down to level 0 (a copy of n / b
+     * values), whose cells are the products of the data with the columns of
+     * the b interpolation P_b; the cells of level 0 of the B buffer are the
+     * products with the columns of P_B. Sampling P_B at the multiples of b and
+     * interpolating with P_b gives P_B back wherever the 2N points used by
+     * P_b lie within a single piece of P_B, i.e., everywhere if N = 1 (linear
+     * interpolation), and otherwise everywhere but near the multiples of B.
+     * So for N = 1 the data is not read at all, and for N >= 2 only the 4N b
+     * values around each multiple of B are (a fraction 4N / b^(k-1) of the
+     * data). The upper levels are then computed from level 0 as usual.
+     *
+     * The other direction, from B to b, cannot be done without the data:
+     * level 0 of the b buffer holds n / b independent products with the data,
+     * which the n / B cells of the B buffer do not determine.
+     */
+    template <class SourceStatistics, class SourceBuffer, class Container, class Storage>
+    void rebaseBuffer(const OlaBuffer<DataType, SourceStatistics>& source, const SourceBuffer& sourcebuffer,
+        const Container& data, Storage& buffer) throw(NotNestedException, InvalidBasisVsDataSizeException,
+        TooSmallException) {
+      const int64 n = data.size();
+      const int b = source.basis();
+      int64 nested = b;
+      while(nested < mB) nested *= b;
+      if((nested != mB) || (source.moments() != mN)) throw NotNestedException();
+      if((n - 1) % mB != 0) throw InvalidBasisVsDataSizeException();
+      assert((int64) sourcebuffer.size() >= source.bufferSize(n));
+      assert((int64) buffer.size() >= bufferSize(n));
+      if(bufferSize(n) < 2 * mN) throw TooSmallException();
+      // level 0 of the source
+      const int64 length = source.bufferSize(n);
+      vector<DataType> bottom(length);
+      for(int64 cell = 0; cell < length; ++cell) bottom[cell] = sourcebuffer[cell];
+      source.untransformUpperLevels(bottom, n);
+      // level 0 of this buffer: P_B^T data = (P_b Q)^T data + (P_B - P_b Q)^T data
+      vector<int64> targets(2 * mN), sourcetargets(2 * mN), innertargets(2 * mN);
+      vector<double> weights(2 * mN), sourceweights(2 * mN), innerweights(2 * mN);
+      const int64 outputs = bufferSize(n);
+      for(int64 cell = 0; cell < outputs; ++cell) buffer[cell] = 0;
+      for(int64 k = 0; k < length; ++k) {
+        const int count = contributions(k * b, outputs, n - 1, & targets[0], & weights[0]);
+        for(int m = 0; m < count; ++m) buffer[targets[m]] += weights[m] * bottom[k];
+      }
+      if(mN == 1) {
+        transformUpperLevels(buffer, n);
+        return;
+      }
+      const int64 radius = 2 * mN * b;
+      int64 x = 0;
+      for(int64 node = 0; node < n; node += mB) {
+        if(x < node - radius) x = node - radius;
+        for(; (x <= node + radius) && (x < n); ++x) {
+          if(x % b == 0) continue;
+          mStats.dataRead(x, sizeof(DataType));
+          const double value = data[x];
+          const int count = contributions(x, outputs, n - 1, & targets[0], & weights[0]);
+          for(int m = 0; m < count; ++m) buffer[targets[m]] += weights[m] * value;
+          const int sourcecount = source.contributions(x, length, n - 1, & sourcetargets[0], & sourceweights[0]);
+          for(int j = 0; j < sourcecount; ++j) {
+            const int innercount = contributions(sourcetargets[j] * b, outputs, n - 1, & innertargets[0],
+                & innerweights[0]);
+            for(int m = 0; m < innercount; ++m)
+              buffer[innertargets[m]] -= innerweights[m] * sourceweights[j] * value;
+          }
+        }
+      }
+      transformUpperLevels(buffer, n);
+    }
+
+    /*
+     * Undoes the levels above 0 of a buffer (of data of length n), in place:
+     * afterwards, cell k is the product of the data with column k of the
+     * interpolation from the multiples of b.
+     */
+    template <class Storage>
+    void untransformUpperLevels(Storage& buffer, const int64 n) const {
+      const int levels = correctionLevels(n);
+      const int64 length = bufferSize(n);
+      int64 stride = 1;
+      for(int level = 1; level < levels - 1; ++level) stride *= mB;
+      vector<int64> targets(2 * mN);
+      vector<double> weights(2 * mN);
+      for(int level = levels - 1; level >= 1; --level, stride /= mB) {
+        const int64 last = (length - 1) / stride;
+        const int64 outputs = length / (mB * stride) + 1;
+        for(int64 i = 0; i <= last; ++i) {
+          if(i % mB == 0) continue;
+          const DataType value = buffer[i * stride];
+          if(value == 0) continue;
+          const int count = contributions(i, outputs, last, & targets[0], & weights[0]);
+          for(int m = 0; m < count; ++m) buffer[targets[m] * mB * stride] -= weights[m] * value;
         }
       }
-      if(verboseTransform) cout << "scale = " << scale << endl;
-      return buffer;
     }
 
-    void updateBuffer(vector<DataType>& buffer, const int64 pos, const DataType change) {
+    /*
+     * To call after data[pos] += change. Any Buffer with operator[] and size()
+     * works (multiseriesbuffer.h uses this to record the cells and weights).
+     */
+    template <class Buffer>
+    void updateBuffer(Buffer& buffer, const int64 pos, const DataType change) {
       //cout << " updating! N= "<< mN << " b = "<< mB  << endl;
       map<int64, DataType> deltas;
       typename map<int64, DataType>::iterator iter;
       deltas[pos] = change;
+      mStats.update();
+      int level = 0;
       for (int64 scale = 1; (mB*scale <= 0 ) ||
         ( (( (int64) buffer.size() - 1 )*mB+1) / (mB * scale) + 1 >= 2 * mN) ;
         scale *= mB) {
@@ -276,10 +691,15 @@ class OlaBuffer {
               int64 index = iter->first;
               DataType value = iter->second;
               if( (index/scale)/mB * mB == index/scale ) continue;
+              mStats.updateDelta(level);
               propagate(index, value, scale, deltas,buffer.size());              
-              if( index /mB * mB == index) buffer[index/mB] += value;
+              if( index /mB * mB == index) {
+                mStats.bufferWrite();
+                buffer[index/mB] += value;
+              }
               deltas.erase(index);
           }
+          ++level;
           // print it out
           //cout << " printing content" << endl;
           //for(iter = deltas.begin(); iter != deltas.end(); iter++) {
@@ -294,7 +714,11 @@ class OlaBuffer {
       for(iter = deltas.begin(); iter != deltas.end(); iter++) {
         int64 index = iter->first;
         DataType value = iter->second;
-        if( index /mB * mB == index) buffer[index/mB] += value;
+        mStats.updateDelta(level);
+        if( index /mB * mB == index) {
+          mStats.bufferWrite();
+          buffer[index/mB] += value;
+        }
         //buffer.erase(index);
       }
     }
@@ -302,11 +726,101 @@ class OlaBuffer {
 
 
 
-    inline void propagate(int64 pos, DataType change, int64 scale, map<int64,DataType>& deltas, int buffer_size) {
+    /*
+     * Adds the polynomial p (its coefficients, constant first) to the data over
+     * [start, end), where data and buffer are overlays on the data and on its
+     * buffer (see polynomialoverlay.h): the data gets one term, and the buffer
+     * one term per level plus a few point writes to its base.
+     *
+     * The transform is linear, and away from the boundaries it is the same for
+     * every output cell, so that a polynomial over a range of the inputs of a
+     * level gives a polynomial (of the same degree) over a range of its
+     * outputs. Only the O(N) outputs at each end of the range, and those near
+     * the ends of the level, are computed one by one (from O(N b) inputs);
+     * they become point deltas at the next level, propagated as in
+     * updateBuffer. This costs O(N b d^2 + N^2) per level for a polynomial of
+     * degree d, whatever the length of the range.
+     */
+    template <class DataOverlay, class BufferOverlay>
+    void updateRange(DataOverlay& data, BufferOverlay& buffer, const int64 start, const int64 end,
+        const vector<double>& p) {
+      const int64 n = data.size();
+      assert(start >= 0);
+      assert(end <= n);
+      assert((int64) buffer.size() >= bufferSize(n));
+      if(start >= end) return;
+      mStats.update();
+      data.addTerm(start, end, 1, p);
+      vector<double> poly(p);// the change of the inputs of the level over [lo, hi)...
+      int64 lo = start, hi = end;
+      map<int64, double> points;// ... plus these
+      vector<int64> targets(2 * mN);
+      vector<double> weights(2 * mN);
+      const int levels = correctionLevels(n);
+      for(int level = 0; level < levels; ++level) {
+        const int64 stride = level == 0 ? 1 : power(level - 1);
+        const int64 outstride = power(level);
+        const int64 length = level == 0 ? n : bufferSize(n);
+        const int64 last = (length - 1) / stride;
+        const int64 outputs = length / (mB * stride) + 1;
+        const bool inplace = level > 0;
+        // the outputs whose inputs are all in [lo, hi) and all in the middle
+        int64 clean0 = (lo + mB - 1) / mB + mN, clean1 = hi / mB - mN + 1;
+        if(clean0 < 2 * mN) clean0 = 2 * mN;
+        if(clean1 > outputs - 2 * mN) clean1 = outputs - 2 * mN;
+        if(clean0 > clean1) clean0 = clean1 = 0;
+        map<int64, double> written, out;// what the level adds to its outputs, and their full change
+        vector<double> q;
+        if(clean0 < clean1) {
+          q = composed(poly, mB, 0);
+          vector<double> added(q.size(), 0.0);
+          for(int m = - mN + 1; m < mN + 1; ++m)
+            for(int r = 1; r < mB; ++r) {
+              const vector<double> term = composed(poly, mB, r - (int64) m * mB);
+              for(uint j = 0; j < term.size(); ++j) added[j] += mDC.coefficients(m, r) * term[j];
+            }
+          for(uint j = 0; j < q.size(); ++j) q[j] += added[j];
+          buffer.addTerm(clean0, clean1, outstride, inplace ? added : q);
+        }
+        // the inputs that contribute to other outputs than the clean ones
+        int64 zone1 = clean0 < clean1 ? (clean0 + mN - 1) * mB : hi;
+        if(zone1 > hi) zone1 = hi;
+        int64 zone2 = clean0 < clean1 ? (clean1 - mN) * mB : hi;
+        if(zone2 < zone1) zone2 = zone1;
+        if(zone2 < lo) zone2 = lo;
+        for(int64 i = lo; i < zone1; ++i)
+          scatter(i, evaluate(poly, i), outputs, last, inplace, clean0, clean1, written, out,
+              & targets[0], & weights[0]);
+        for(int64 i = zone2; i < hi; ++i)
+          scatter(i, evaluate(poly, i), outputs, last, inplace, clean0, clean1, written, out,
+              & targets[0], & weights[0]);
+        for(map<int64, double>::const_iterator it = points.begin(); it != points.end(); ++it)
+          scatter(it->first, it->second, outputs, last, inplace, 0, 0, written, out, & targets[0], & weights[0]);
+        for(map<int64, double>::const_iterator it = written.begin(); it != written.end(); ++it) {
+          mStats.bufferWrite();
+          buffer.base()[it->first * outstride] += it->second;
+        }
+        poly = q;
+        lo = clean0;
+        hi = clean1;
+        points.swap(out);
+      }
+    }
+
+    // same, for the cubic polynomial over its range
+    template <class DataOverlay, class BufferOverlay>
+    void updateRange(DataOverlay& data, BufferOverlay& buffer, const RangedCubicPolynomial& p) {
+      vector<double> coefficients(4);
+      coefficients[0] = p.mA0; coefficients[1] = p.mA1; coefficients[2] = p.mA2; coefficients[3] = p.mA3;
+      while((coefficients.size() > 1) && (coefficients.back() == 0)) coefficients.pop_back();
+      updateRange(data, buffer, p.mStart, p.mEnd, coefficients);
+    }
+
+    void propagate(int64 pos, DataType change, int64 scale, map<int64,DataType>& deltas, int64 buffer_size) {
         const int64 i = pos / scale;
         const int64 k = i / mB;
         const int r = i % mB;
-        const int buffersize = (buffer_size - 1 ) / scale + 1;
+        const int64 buffersize = (buffer_size - 1 ) / scale + 1;
         if ( k - mN + 1 < 0 ) { // left
             const int min = 0 , max = 2 * mN ;
             for(int m = min ; m < max ; ++m) {
@@ -315,7 +829,7 @@ class OlaBuffer {
         } else if (k + mN >= buffersize ) { // right
           const int min = 0 , max = 2 * mN;
           for(int m = min ; m < max ; ++m) {
-            const int reversedi = (mB*(buffer_size-1))/scale  - i;
+            const int64 reversedi = (mB*(buffer_size-1))/scale  - i;
             deltas[(buffersize - 2*mN + m )  * scale *mB ] += 
                 mDC.leftCoefficients(2 * mN - 1 - m, reversedi) * change;
             }
@@ -337,10 +851,10 @@ class OlaBuffer {
         if(
             (mB*scale <= 0 ) 
             ||
-            ( (( (int) buffer.size() - 1 )*mB+1) / (mB * scale) + 1 < 2 * mN)
+            ( (( (int64) buffer.size() - 1 )*mB+1) / (mB * scale) + 1 < 2 * mN)
         ) return false; // we stop here
         assert(pos % scale == 0);
-        const int buffersize = (buffer.size() - 1 ) / scale + 1;
+        const int64 buffersize = (buffer.size() - 1 ) / scale + 1;
         const int64 i = pos / scale;
         const int64 k = i / mB;
         assert(k >= 0); 
@@ -360,7 +874,7 @@ class OlaBuffer {
           const int min = 0 , max = 2 * mN ;
           for(int m = min ; m < max ; ++m) {
             assert(m >= 0);
-            assert(m * scale < (int) buffer.size());
+            assert(m * scale < (int64) buffer.size());
             if(!updateBuffer(buffer, m*scale*mB,mDC.leftCoefficients(m  ,i ) * change,scale*mB)) {
               if(verboseUpdate) 
                 cout << "(left)%buffer[" << m*scale << "] += " << 
@@ -373,8 +887,8 @@ class OlaBuffer {
           const int min = 0 , max = 2 * mN;
           for(int m = min ; m < max ; ++m) {
             assert(buffersize - 2*mN + m >= 0);
-            assert((buffersize - 2*mN + m )  * scale < (int) buffer.size());
-            const int reversedi = (mB*(buffer.size()-1))/scale  - i;
+            assert((buffersize - 2*mN + m )  * scale < (int64) buffer.size());
+            const int64 reversedi = (mB*(buffer.size()-1))/scale  - i;
             if(! updateBuffer(buffer, (buffersize - 2*mN + m )  * scale * mB,
                 mDC.leftCoefficients(2 * mN - 1 - m, reversedi) * change, scale*mB )) {
               if(verboseUpdate) cout << "(right)%% scale = "<<scale
@@ -391,7 +905,7 @@ class OlaBuffer {
           const int min =  - mN + 1, max =  mN + 1 ;
           for(int m = min ; m < max ; ++m) {
             assert(k + m >= 0);
-            assert((k+ m )*scale< (int) buffer.size());
+            assert((k+ m )*scale< (int64) buffer.size());
             if( ! updateBuffer(buffer, (k + m) * scale*mB,mDC.coefficients(m, r ) * change,scale*mB) ) {
               if(verboseUpdate) cout << "(middle)%%%% scale = "<<scale<<" buffer[" << (k+m)*scale << "] += " 
               << mDC.coefficients(m, r ) * change << endl;
@@ -410,15 +924,16 @@ class OlaBuffer {
      * You would typically not call this method, except for debugging purposes maybe or
      * if you want to solve an interpolation problem.
      */
-    inline float interpolate(int64 index, int scale, RangedFunction& f, int64 Length) const {
+    float interpolate(int64 index, int64 scale, RangedFunction& f, int64 Length) const {
     if(verboseInterpolate)  cout << "*********************interpolate " << scale << endl;
+    mStats.interpolation();
     assert(index >= 0);
     assert(index < Length);
     assert(scale > 0); 
     assert(scale < Length);
     assert((Length - 1) / scale * scale  == Length - 1); 
-    int axis = index / (scale*mB) * (scale*mB) ;
-    int r = ((index - axis) / scale) % mB;
+    const int64 axis = index / (scale*mB) * (scale*mB) ;
+    const int r = ((index - axis) / scale) % mB;
     if(verboseInterpolate)
       cout << " index = " << index << " scale = " << scale << " axis = " << axis << " r = " << r << endl;
     assert ( r < mB);
@@ -508,13 +1023,29 @@ class OlaBuffer {
       //equal or larger than the given argument
       const int steps = levels(Length);
       const int64 TransformRatio = power(steps);
-      int leftover = (Length - 1) / TransformRatio;
+      int64 leftover = (Length - 1) / TransformRatio;
       if ( (Length - 1) % TransformRatio > 0) ++leftover;
       return leftover * TransformRatio + 1;
     }
 
+    /*
+     * The data indexes [first, second) that a query over [start, end) reads or
+     * depends on: the range itself together with the boundary windows around
+     * start and end. Changing the data outside of this interval leaves the answer
+     * of such a query unchanged (up to floating-point rounding, since the buffer
+     * contributions cancel exactly only in exact arithmetic).
+     */
+    inline pair<int64,int64> dataDependency(const int64 start, const int64 end, const int64 n) const {
+      pair<int64,int64> begin = imperfectRange(start, 1, n);
+      pair<int64,int64> finish = imperfectRange(end, 1, n);
+      int64 lower = start, higher = end;
+      if(begin.second > begin.first && begin.first < lower) lower = begin.first;
+      if(finish.second > finish.first && finish.second > higher) higher = finish.second;
+      return pair<int64,int64>(lower, higher);
+    }
+
      // this determines the lower range and top of the lazy transform
-    inline pair<int64,int64> testImperfectRange(const int64 x, const int scale, const int64 n) const {
+    pair<int64,int64> testImperfectRange(const int64 x, const int64 scale, const int64 n) const {
       cout << " testing range code...******** x="<< x << " n = " << n << endl;
       assert(scale > 0);
       // first, some special cases...
@@ -540,7 +1071,68 @@ class OlaBuffer {
    
    
   protected:
-    inline pair<int64,int64> imperfectRange(const int64 x, const int scale, const int64 n) const {
+    // adds the terms of a level (levels being the top one) to sum, in the order query(f, ...) does
+    template <class Container, class Buffer>
+    void addLevel(RangedFunction& f, const int level, const int levels, const int64 n, const Container& data,
+        const Buffer& buffer, float & sum) const {
+      const int64 scale = power(level);
+      if(level == levels) {
+        const int64 blockbegin = f.mStart / scale * scale + (f.mStart % scale != 0 ? scale : 0);
+        const int64 blockend = f.mEnd / scale  * scale + 1;
+        for(int64 index = blockbegin; index < blockend ; index += scale) {
+          mStats.bufferRead(level);
+          sum += f(index) * buffer[index/mB];
+        }
+        return;
+      }
+      pair<int64,int64> begin, end;
+      levelWindows(f, scale, n, begin, end);
+      for(int w = 0; w < 2; ++w) {
+        const pair<int64,int64> & window = (w == 0) ? begin : end;
+        for (int64 index = window.first; index < window.second; index += scale) {
+          if(level == 0) {
+            mStats.dataRead(index, sizeof(DataType));
+            sum += (f(index) - interpolate(index,scale,f,n)) * data[index];
+          } else {
+            mStats.bufferRead(level);
+            sum += (f(index) - interpolate(index,scale,f,n)) * buffer[index/mB];
+          }
+        }
+      }
+    }
+
+    // prefetches the buffer cells a query of f reads at this level (levels being the top level)
+    template <class Buffer>
+    inline void prefetchLevel(const RangedFunction& f, const int level, const int levels, const Buffer& buffer,
+        const int64 n) const {
+      const int64 scale = power(level);
+      // cells at this level are scale / mB apart in the buffer: one prefetch per cache line
+      const int64 apart = (scale / mB) * sizeof(DataType);
+      const int64 step = apart >= CacheLineBytes ? scale : scale * (CacheLineBytes / apart);
+      if(level == levels) {
+        const int64 blockbegin = f.mStart / scale * scale + (f.mStart % scale != 0 ? scale : 0);
+        const int64 blockend = f.mEnd / scale  * scale + 1;
+        for(int64 index = blockbegin; index < blockend ; index += step)
+          __builtin_prefetch(& buffer[index/mB]);
+        return;
+      }
+      pair<int64,int64> begin, end;
+      levelWindows(f, scale, n, begin, end);
+      for (int64 index = begin.first; index < begin.second; index += step) __builtin_prefetch(& buffer[index/mB]);
+      for (int64 index = end.first; index < end.second; index += step) __builtin_prefetch(& buffer[index/mB]);
+    }
+
+    enum { CacheLineBytes = 64 };
+
+    // the two windows read by the query loop at this scale, made disjoint
+    inline void levelWindows(const RangedFunction& f, const int64 scale, const int64 n,
+        pair<int64,int64>& begin, pair<int64,int64>& end) const {
+      begin = imperfectRange(f.mStart,scale,n);
+      end = imperfectRange(f.mEnd,scale,n);
+      if(begin.second > end.first) end.first = begin.second; // overlap
+    }
+
+    pair<int64,int64> imperfectRange(const int64 x, const int64 scale, const int64 n) const {
       assert(scale > 0);
       // first, some special cases...
       if(x == 0) return pair<int64,int64>(0,0); // no error 
@@ -558,55 +1150,151 @@ class OlaBuffer {
     }
   
    
-    // used to compute the transform
-    template<class GenericContainer>
-    counted_ptr<vector<DataType> > 
-    transformOnce (GenericContainer& data, uint scale ) throw ( TooSmallException ) {
-      int64 k;
-      int min, max, r;
-      const int buffersize = data.size() /( mB * scale) + 1;
+    // the levels above 0 of computeBuffer, level 0 being in the buffer
+    template<class Storage>
+    void transformUpperLevels(Storage& buffer, const int64 n) throw ( TooSmallException ) {
+      int level = 0;
+      for (int64 scale = mB ; 
+          (mB*scale > 0 ) && ((uint64) n / (mB * scale) + 1 >= (uint) 2 * mN); scale *= mB) {
+        if(verboseTransform) cout << " data.size() = " << n 
+          << " scale = " << scale << " mN = "<< mN << endl;
+        transformOnce(buffer, bufferSize(n), buffer, scale / mB, ++level);
+      }
+    }
+
+    /*
+     * Used to compute the transform, one level at a time. At level 0, the input
+     * is the data (of the given length) and the output (the buffer) is cleared
+     * first. At level l >= 1, the input is the buffer (length is bufferSize(n))
+     * read with the given stride (cells of level l - 1)
+     * and the output is the same buffer: cell k of level l is the input cell
+     * k b, which stays in place, plus the contributions of the cells that are
+     * not multiples of b, which are read but never written.
+     */
+    template<class Input, class Storage>
+    void transformOnce (const Input& data, const int64 length, Storage& buffer, const int64 stride,
+        const int level ) throw ( TooSmallException ) {
+      const int64 scale = stride;
+      const int64 outstride = level == 0 ? 1 : mB * stride;// output cell k is buffer[k * outstride]
+      const int64 buffersize = length /( mB * scale) + 1;
       if(verboseTransformOnce) { 
-        cout << " scale = " << scale << " data.size() = " << data.size() << " buffersize = " << buffersize
+        cout << " scale = " << scale << " length = " << length << " buffersize = " << buffersize
         << " mB = " << mB << endl;
-        for(uint p = 0; p < data.size(); ++p) cout << " data["<<p<<"]= " << data[p] ;
-        cout << endl;
       }
       if (buffersize < 2 * mN) throw TooSmallException();
-      counted_ptr<vector<DataType> >  buffer ( new vector<DataType>(buffersize, 0));
-      for (uint i = 0; i*scale < data.size() ; ++i) {
-        if(verboseTransformOnce) 
-          cout << " using data point data["<< i*scale << " ] = " << data[i*scale]<<endl;
-        assert(i >=0); assert(i * scale < data.size());
-        if(data[i * scale] == 0) continue;
-        k = i / mB;
-        assert(k >= 0); 
-        assert((uint)k < buffer->size());
-        r = i % mB;
-        if( r == 0 ){
-          (*buffer)[k] += data[i * scale];
-          continue;
+      if (level == 0) for (int64 cell = 0; cell < buffersize; ++cell) buffer[cell] = 0;
+      for (int64 i = 0; i*scale < length ; ++i) {
+        mStats.transformCell(level);
+        if(level == 0) mStats.dataRead(i, sizeof(DataType));
+        transformCell(data[i * scale], i, buffer, outstride, buffersize, (length - 1)/scale, level);
+      }
+    }
+
+  public:
+    /*
+     * What transformOnce does with input cell i of a level, of the given value:
+     * add its contributions to the output cells (cell k is buffer[k * outstride]),
+     * buffersize being the number of output cells and last the index of the last
+     * input cell. Also used by the streaming construction (see olastream.h).
+     */
+    template<class Storage>
+    void transformCell(const DataType value, const int64 i, Storage& buffer, const int64 outstride,
+        const int64 buffersize, const int64 last, const int level) {
+      if(value == 0) return;
+      const int64 k = i / mB;
+      assert(k >= 0); 
+      assert(k < buffersize);
+      const int r = i % mB;
+      if( r == 0 ){
+        if(level == 0) buffer[k] += value;
+        return;
+      }
+      if ( k - mN + 1 < 0 ) { // left
+        for(int m = 0 ; m < 2 * mN ; ++m) {
+          buffer[ m * outstride ] += mDC.leftCoefficients(m  ,i ) * value;
         }
-        if ( k - mN + 1 < 0 ) { // left
-          min = 0 ; max = 2 * mN ;
-          for(int m = min ; m < max ; ++m) {
-            (*buffer)[ m ] += mDC.leftCoefficients(m  ,i ) * data[ i * scale];
-          }
-        } else if (k + mN >= buffersize ) { // right
-          min = 0 ; max = 2 * mN;
-          for(int m = min ; m < max ; ++m) {
-            (*buffer)[buffersize - 2*mN + m  ] += 
-              mDC.leftCoefficients(2 * mN - 1 - m, data.size()/scale - 1 - i) * data[ i * scale];
-          }
+      } else if (k + mN >= buffersize ) { // right
+        for(int m = 0 ; m < 2 * mN ; ++m) {
+          buffer[(buffersize - 2*mN + m) * outstride ] += 
+            mDC.leftCoefficients(2 * mN - 1 - m, last - i) * value;
+        }
+      } else { // middle
+        const double * row = mDC.coefficientRow(r) + mN - 1;
+        for(int m = - mN + 1 ; m < mN + 1 ; ++m) {
+          assert(k + m >= 0);
+          assert(k+ m < buffersize);
+          buffer[(k + m) * outstride ] += row[m] * value;
+        }
+      }
+    }
+
+    /*
+     * The output cells input cell i of a level contributes to (as in
+     * transformCell), and with which weights: that is row i of the
+     * interpolation from the outputs to the inputs. Returns how many, which is
+     * 1 (cell i / b itself) if i is a multiple of b, and 2N otherwise.
+     */
+    int contributions(const int64 i, const int64 buffersize, const int64 last, int64 * targets,
+        double * weights) const {
+      const int64 k = i / mB;
+      const int r = i % mB;
+      if(r == 0) {
+        targets[0] = k;
+        weights[0] = 1;
+        return 1;
+      }
+      for(int m = 0; m < 2 * mN; ++m) {
+        if(k - mN + 1 < 0) { // left
+          targets[m] = m;
+          weights[m] = mDC.leftCoefficients(m, i);
+        } else if(k + mN >= buffersize) { // right
+          targets[m] = buffersize - 2 * mN + m;
+          weights[m] = mDC.leftCoefficients(2 * mN - 1 - m, last - i);
         } else { // middle
-          min =  - mN + 1; max =  mN + 1 ; 
-          for(int m = min ; m < max ; ++m) {
-            assert(k + m >= 0);
-            assert(k+ m < (int64) buffer->size());
-            (*buffer)[k + m ] += mDC.coefficients(m, r ) * data[ i * scale];
-          }
+          targets[m] = k + m - mN + 1;
+          weights[m] = mDC.coefficients(m - mN + 1, r);
         }
       }
-      return buffer;
+      return 2 * mN;
+    }
+
+  protected:
+
+    /*
+     * What transformCell does with input cell i (of the given change), except
+     * that outputs in [skip0, skip1) are left out: out gets the change of the
+     * outputs, and written what is added to the buffer (the same, but for the
+     * input cells that are also output cells, in place, at levels above 0).
+     * targets and weights are room for 2N values.
+     */
+    inline void scatter(const int64 i, const double value, const int64 buffersize, const int64 last,
+        const bool inplace, const int64 skip0, const int64 skip1, map<int64, double>& written,
+        map<int64, double>& out, int64 * targets, double * weights) const {
+      const int count = contributions(i, buffersize, last, targets, weights);
+      for(int m = 0; m < count; ++m) {
+        if((targets[m] >= skip0) && (targets[m] < skip1)) continue;
+        out[targets[m]] += weights[m] * value;
+        if(!inplace || (i % mB != 0)) written[targets[m]] += weights[m] * value;
+      }
+    }
+
+    // p(x), p given by its coefficients
+    static inline double evaluate(const vector<double>& p, const int64 x) {
+      double answer = 0;
+      for(int j = p.size() - 1; j >= 0; --j) answer = answer * x + p[j];
+      return answer;
+    }
+
+    // the coefficients of k -> p(scale k + shift)
+    static vector<double> composed(const vector<double>& p, const int64 scale, const int64 shift) {
+      vector<double> answer(p.size(), 0.0);
+      for(int j = p.size() - 1; j >= 0; --j) {
+        // answer = answer * (scale k + shift) + p[j]
+        for(int i = answer.size() - 1; i >= 0; --i)
+          answer[i] = answer[i] * shift + (i > 0 ? answer[i - 1] * scale : 0.0);
+        answer[0] += p[j];
+      }
+      return answer;
     }
 
  
@@ -620,6 +1308,7 @@ class OlaBuffer {
 
     int mB, mN;
     DubucCoefficients mDC;
+    mutable Statistics mStats;
 
 };
 
@@ -0,0 +1,301 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef OLAEXECUTOR_H
+#define OLAEXECUTOR_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <vector>
+#include <deque>
+#include <cassert>
+#include "olabuffer.h"
+
+using namespace std;
+
+/*
+ * Something to run on an OlaExecutor. The executor deletes it once run.
+ */
+class OlaTask {
+  public:
+    virtual ~OlaTask() {}
+    virtual void run() = 0;
+};
+
+/*
+ * A batch of count independent jobs: the executor runs execute(begin, end)
+ * on disjoint ranges covering [0, count), and wait() returns once they are
+ * all done, much like a future. Ranges are split adaptively: a worker takes
+ * Grain jobs at a time from its range, and gives half of what is left to the
+ * other workers whenever some of them are idle.
+ */
+class OlaBatch {
+  public:
+    OlaBatch(const int64 Count, const int64 Grain = 16) : mCount(Count), mGrain(Grain > 0 ? Grain : 1), mDone(0) {
+      pthread_mutex_init(& mLock, 0);
+      pthread_cond_init(& mFinished, 0);
+    }
+    virtual ~OlaBatch() {
+      pthread_cond_destroy(& mFinished);
+      pthread_mutex_destroy(& mLock);
+    }
+
+    virtual void execute(const int64 begin, const int64 end) = 0;
+
+    int64 size() const { return mCount; }
+    int64 grain() const { return mGrain; }
+
+    bool done() {
+      pthread_mutex_lock(& mLock);
+      const bool answer = mDone == mCount;
+      pthread_mutex_unlock(& mLock);
+      return answer;
+    }
+
+    void wait() {
+      pthread_mutex_lock(& mLock);
+      while(mDone < mCount) pthread_cond_wait(& mFinished, & mLock);
+      pthread_mutex_unlock(& mLock);
+    }
+
+    // called by the executor
+    void completed(const int64 jobs) {
+      pthread_mutex_lock(& mLock);
+      mDone += jobs;
+      if(mDone == mCount) pthread_cond_broadcast(& mFinished);
+      pthread_mutex_unlock(& mLock);
+    }
+
+  protected:
+    int64 mCount, mGrain, mDone;
+    pthread_mutex_t mLock;
+    pthread_cond_t mFinished;
+};
+
+/*
+ * A pool of worker threads, one per core by default (and pinned to it), each
+ * with its own deque of tasks: a worker pushes and pops at the back of its
+ * own deque, and when it is empty steals from the front of the others'.
+ *
+ *  OlaExecutor executor;  // all the cores
+ *  vector<float> answers(count);
+ *  OlaQueryBatch< float, vector<float>, vector<float> > batch(ob, functions, count, data, *buffer, & answers[0]);
+ *  executor.submit(batch);
+ *  ... // other work
+ *  batch.wait();
+ *
+ * The buffers and the data are shared read-only by the workers, which is safe
+ * for queries as long as the OlaBuffer does not collect statistics
+ * (NoOlaStatistics, the default) and nothing updates them meanwhile.
+ */
+class OlaExecutor {
+  public:
+    // Threads = 0 means one per online core
+    OlaExecutor(int Threads = 0, const bool Pin = true) : mStop(false), mPending(0), mIdle(0), mNext(0) {
+      if(Threads <= 0) Threads = cores();
+      pthread_mutex_init(& mSleepLock, 0);
+      pthread_cond_init(& mWake, 0);
+      for(int w = 0; w < Threads; ++w) mWorkers.push_back(new Worker(this, w));
+      for(int w = 0; w < Threads; ++w) {
+        pthread_create(& mWorkers[w]->thread, 0, & OlaExecutor::loop, mWorkers[w]);
+        if(Pin) pin(mWorkers[w]->thread, w % cores());
+      }
+    }
+
+    virtual ~OlaExecutor() {
+      pthread_mutex_lock(& mSleepLock);
+      mStop = true;
+      pthread_cond_broadcast(& mWake);
+      pthread_mutex_unlock(& mSleepLock);
+      for(uint w = 0; w < mWorkers.size(); ++w) pthread_join(mWorkers[w]->thread, 0);
+      for(uint w = 0; w < mWorkers.size(); ++w) {
+        for(uint k = 0; k < mWorkers[w]->tasks.size(); ++k) delete mWorkers[w]->tasks[k];
+        delete mWorkers[w];
+      }
+      pthread_cond_destroy(& mWake);
+      pthread_mutex_destroy(& mSleepLock);
+    }
+
+    int threads() const { return mWorkers.size(); }
+
+    static int cores() {
+      const long answer = sysconf(_SC_NPROCESSORS_ONLN);
+      return answer > 0 ? answer : 1;
+    }
+
+    // runs the batch on the pool, returns at once (see OlaBatch::wait)
+    void submit(OlaBatch & batch) {
+      if(batch.size() == 0) return;
+      push(new RangeTask(this, & batch, 0, batch.size()));
+    }
+
+    // submit and wait
+    void run(OlaBatch & batch) {
+      submit(batch);
+      batch.wait();
+    }
+
+    // any task; it is deleted once run
+    void push(OlaTask * task) {
+      Worker * w = current();
+      if(w == 0) {// from outside the pool, round robin
+        pthread_mutex_lock(& mSleepLock);
+        w = mWorkers[mNext++ % mWorkers.size()];
+        pthread_mutex_unlock(& mSleepLock);
+      }
+      pthread_mutex_lock(& w->lock);
+      w->tasks.push_back(task);
+      pthread_mutex_unlock(& w->lock);
+      pthread_mutex_lock(& mSleepLock);
+      ++mPending;
+      pthread_cond_signal(& mWake);
+      pthread_mutex_unlock(& mSleepLock);
+    }
+
+    // whether some workers wait for tasks
+    inline bool hungry() const { return * (volatile const int *) & mIdle > 0; }
+
+  protected:
+    struct Worker {
+      Worker(OlaExecutor * Pool, int Id) : pool(Pool), id(Id) { pthread_mutex_init(& lock, 0); }
+      ~Worker() { pthread_mutex_destroy(& lock); }
+      OlaExecutor * pool;
+      int id;
+      pthread_t thread;
+      pthread_mutex_t lock;
+      deque<OlaTask *> tasks;
+    };
+
+    // the jobs [begin, end) of a batch, split while others are idle
+    struct RangeTask : public OlaTask {
+      RangeTask(OlaExecutor * Pool, OlaBatch * Batch, int64 Begin, int64 End) :
+        pool(Pool), batch(Batch), begin(Begin), end(End) {}
+      virtual void run() {
+        while(begin < end) {
+          if((end - begin > 2 * batch->grain()) && pool->hungry()) {
+            const int64 middle = begin + (end - begin) / 2;
+            pool->push(new RangeTask(pool, batch, middle, end));
+            end = middle;
+            continue;
+          }
+          const int64 stop = end - begin > batch->grain() ? begin + batch->grain() : end;
+          batch->execute(begin, stop);
+          batch->completed(stop - begin);
+          begin = stop;
+        }
+      }
+      OlaExecutor * pool;
+      OlaBatch * batch;
+      int64 begin, end;
+    };
+
+    static void * loop(void * arg) {
+      Worker * self = (Worker *) arg;
+      OlaExecutor * pool = self->pool;
+      pthread_setspecific(key(), self);
+      for(;;) {
+        OlaTask * task = pool->take(self);
+        if(task == 0) return 0;
+        task->run();
+        delete task;
+      }
+    }
+
+    // own tasks first (newest), then steal (oldest), else sleep; 0 when stopping
+    OlaTask * take(Worker * self) {
+      for(;;) {
+        pthread_mutex_lock(& mSleepLock);
+        while((mPending == 0) && !mStop) {
+          ++mIdle;
+          pthread_cond_wait(& mWake, & mSleepLock);
+          --mIdle;
+        }
+        if(mPending == 0) { pthread_mutex_unlock(& mSleepLock); return 0; }
+        --mPending;// we will find it
+        pthread_mutex_unlock(& mSleepLock);
+        for(;;) {
+          OlaTask * task = 0;
+          pthread_mutex_lock(& self->lock);
+          if(!self->tasks.empty()) { task = self->tasks.back(); self->tasks.pop_back(); }
+          pthread_mutex_unlock(& self->lock);
+          for(uint k = 1; (task == 0) && (k < mWorkers.size()); ++k) {
+            Worker * victim = mWorkers[(self->id + k) % mWorkers.size()];
+            pthread_mutex_lock(& victim->lock);
+            if(!victim->tasks.empty()) { task = victim->tasks.front(); victim->tasks.pop_front(); }
+            pthread_mutex_unlock(& victim->lock);
+          }
+          if(task != 0) return task;
+          sched_yield();// pushed but not yet visible
+        }
+      }
+    }
+
+    Worker * current() const {
+      Worker * w = (Worker *) pthread_getspecific(key());
+      return (w != 0) && (w->pool == this) ? w : 0;
+    }
+
+    static pthread_key_t key() {
+      static pthread_once_t once = PTHREAD_ONCE_INIT;
+      pthread_once(& once, & makeKey);
+      return storedKey();
+    }
+    static pthread_key_t & storedKey() {
+      static pthread_key_t answer;
+      return answer;
+    }
+    static void makeKey() { pthread_key_create(& storedKey(), 0); }
+
+    static void pin(pthread_t thread, const int core) {
+#ifdef CPU_SET
+      cpu_set_t set;
+      CPU_ZERO(& set);
+      CPU_SET(core, & set);
+      pthread_setaffinity_np(thread, sizeof(set), & set);
+#endif
+    }
+
+    vector<Worker *> mWorkers;
+    bool mStop;
+    int mPending, mIdle;
+    uint mNext;
+    pthread_mutex_t mSleepLock;
+    pthread_cond_t mWake;
+};
+
+/*
+ * count queries f[k] over the same data and buffer, answers[k] being the
+ * query of f[k].
+ */
+template <class DataType, class Container, class Buffer, class Statistics = NoOlaStatistics>
+class OlaQueryBatch : public OlaBatch {
+  public:
+    OlaQueryBatch(const OlaBuffer<DataType, Statistics> & ob, RangedFunction * const * f, const int64 count,
+        const Container & data, const Buffer & buffer, float * answers, const int64 Grain = 16) :
+      OlaBatch(count, Grain), mOB(ob), mF(f), mData(data), mBuffer(buffer), mAnswers(answers) {}
+
+    virtual void execute(const int64 begin, const int64 end) {
+      for(int64 k = begin; k < end; ++k) mAnswers[k] = mOB.query(* mF[k], mData, mBuffer);
+    }
+
+  protected:
+    const OlaBuffer<DataType, Statistics> & mOB;
+    RangedFunction * const * mF;
+    const Container & mData;
+    const Buffer & mBuffer;
+    float * mAnswers;
+};
+
+#endif
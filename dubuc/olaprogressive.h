@@ -0,0 +1,103 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef OLAPROGRESSIVE_H
+#define OLAPROGRESSIVE_H
+
+#include <vector>
+#include "olabuffer.h"
+
+using namespace std;
+
+/*
+ * Progressive (approximate, then exact) evaluation of an Ola query.
+ *
+ * The first estimate only reads the top level of the buffer; each call to
+ * refine() adds the boundary correction of the next finer level, so that the
+ * last refinement (level 0) is the only one that reads the data, and gives
+ * the exact answer of OlaBuffer::query. After each step, errorBound() is a
+ * rigorous bound on |exact - estimate()|: the sum, over the levels not yet
+ * read, of levelResidual (which reads nothing) times the largest value at
+ * that level (see OlaBuffer::levelBounds, computed once per buffer).
+ *
+ *  vector<double> bounds = ob.levelBounds(*buffer, maxAbsData, data.size());
+ *  ProgressiveQuery< float, ExternalArray<float> > pq(ob, rcp, data, *buffer, bounds);
+ *  while(!pq.exact() && pq.errorBound() > tolerance) pq.refine();
+ *  float answer = pq.estimate();
+ *
+ * The bounds must be recomputed (or increased) after updates. Note that the
+ * bound is on the mathematical error; the float arithmetic adds its own rounding.
+ */
+template <class DataType, class Container, class Statistics = NoOlaStatistics>
+class ProgressiveQuery {
+  public:
+    ProgressiveQuery(const OlaBuffer<DataType, Statistics> & ob, RangedFunction & f, const Container & data,
+        const vector<DataType> & buffer, const vector<double> & levelbounds) :
+      mOB(ob), mF(f), mData(data), mBuffer(buffer),
+      mLevel(ob.correctionLevels(data.size())), mResiduals(mLevel, 0.0) {
+      assert((int) levelbounds.size() >= mLevel);
+      mEstimate = ob.topLevelSum(f, buffer, data.size());
+      mErrorBound = 0.0;
+      for(int level = 0; level < mLevel; ++level) {
+        mResiduals[level] = ob.levelResidual(f, level, data.size()) * levelbounds[level];
+        mErrorBound += mResiduals[level];
+      }
+    }
+
+    float estimate() const { return mEstimate; }
+    double errorBound() const { return mErrorBound; }
+    // the finest level included so far (0 when exact)
+    int level() const { return mLevel; }
+    bool exact() const { return mLevel == 0; }
+
+    // includes the next finer level; returns false if we were already exact
+    bool refine() {
+      if(exact()) return false;
+      --mLevel;
+      mEstimate += mOB.levelCorrection(mF, mLevel, mData, mBuffer);
+      mErrorBound -= mResiduals[mLevel];
+      if(mLevel == 0 || mErrorBound < 0) mErrorBound = 0.0;
+      return true;
+    }
+
+    // refines until the error bound is at most Tolerance, or exact
+    float refineUntil(const double Tolerance) {
+      while((mErrorBound > Tolerance) && refine()) {}
+      return mEstimate;
+    }
+
+  protected:
+    const OlaBuffer<DataType, Statistics> & mOB;
+    RangedFunction & mF;
+    const Container & mData;
+    const vector<DataType> & mBuffer;
+    int mLevel;
+    vector<double> mResiduals;
+    float mEstimate;
+    double mErrorBound;
+};
+
+/*
+ * Callback form: calls callback(estimate, errorbound, level) after the top-level
+ * estimate and after each refinement, and stops as soon as it returns false.
+ * Returns the last estimate.
+ */
+template <class DataType, class Container, class Statistics, class Callback>
+float progressiveQuery(const OlaBuffer<DataType, Statistics> & ob, RangedFunction & f, const Container & data,
+    const vector<DataType> & buffer, const vector<double> & levelbounds, Callback & callback) {
+  ProgressiveQuery<DataType, Container, Statistics> pq(ob, f, data, buffer, levelbounds);
+  while(callback(pq.estimate(), pq.errorBound(), pq.level()) && pq.refine()) {}
+  return pq.estimate();
+}
+
+#endif
@@ -0,0 +1,138 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef OLAQUERYCACHE_H
+#define OLAQUERYCACHE_H
+
+#include <map>
+#include <list>
+#include <iostream>
+#include "olabuffer.h"
+#include "cubicpolynomial.h"
+
+using namespace std;
+
+/*
+ * A cache of query results in front of OlaBuffer::query, for workloads that
+ * repeat the same (start, end, polynomial) queries between updates.
+ *
+ *  OlaQueryCache< float > cache(ob, 4096);
+ *  float answer = cache.query(rcp, data, *buffer);  // computed once, then cached
+ *  data[pos] += change;
+ *  cache.updateBuffer(*buffer, pos, change);  // also drops the affected entries
+ *
+ * Invalidation is precise: an update at pos only drops the entries whose
+ * dependency interval (the range and its boundary windows, see
+ * OlaBuffer::dataDependency) contains pos. Every other entry stays valid, up to
+ * floating-point rounding of the buffer terms that cancel out. If you modify
+ * the data or the buffer yourself, call invalidate(pos).
+ *
+ * When full, the least recently used entry is evicted. Invalidation scans the
+ * entries, so its cost is linear in the capacity (a few thousand entries is fine).
+ */
+template <class DataType, class Statistics = NoOlaStatistics>
+class OlaQueryCache {
+  public:
+    OlaQueryCache(OlaBuffer<DataType, Statistics> & ob, const uint Capacity) :
+      mOB(ob), mCapacity(Capacity), mHits(0), mMisses(0), mInvalidations(0), mEvictions(0) {
+      assert(Capacity > 0);
+    }
+
+    template <class Container>
+    float query(RangedCubicPolynomial & f, const Container & data, vector<DataType> & buffer) {
+      const Key key(f);
+      typename map<Key, Entry>::iterator iter = mEntries.find(key);
+      if(iter != mEntries.end()) {
+        ++mHits;
+        mRecency.splice(mRecency.begin(), mRecency, iter->second.recency);
+        return iter->second.answer;
+      }
+      ++mMisses;
+      const float answer = mOB.query(f, data, buffer);
+      if(mEntries.size() >= mCapacity) {
+        mEntries.erase(mRecency.back());
+        mRecency.pop_back();
+        ++mEvictions;
+      }
+      mRecency.push_front(key);
+      Entry & e = mEntries[key];
+      e.answer = answer;
+      e.dependency = mOB.dataDependency(f.mStart, f.mEnd, data.size());
+      e.recency = mRecency.begin();
+      return answer;
+    }
+
+    // updates the buffer (the caller updates the data) and invalidates what it affects
+    void updateBuffer(vector<DataType> & buffer, const int64 pos, const DataType change) {
+      mOB.updateBuffer(buffer, pos, change);
+      invalidate(pos);
+    }
+
+    // drops the cached answers that depend on data[pos]
+    void invalidate(const int64 pos) {
+      typename map<Key, Entry>::iterator iter = mEntries.begin();
+      while(iter != mEntries.end()) {
+        if((iter->second.dependency.first <= pos) && (pos < iter->second.dependency.second)) {
+          mRecency.erase(iter->second.recency);
+          mEntries.erase(iter++);
+          ++mInvalidations;
+        } else ++iter;
+      }
+    }
+
+    void clear() { mEntries.clear(); mRecency.clear(); }
+
+    uint size() const { return mEntries.size(); }
+    uint capacity() const { return mCapacity; }
+    uint64 hits() const { return mHits; }
+    uint64 misses() const { return mMisses; }
+    uint64 invalidations() const { return mInvalidations; }
+    uint64 evictions() const { return mEvictions; }
+    double hitRate() const { return mHits + mMisses == 0 ? 0.0 : mHits / (double) (mHits + mMisses); }
+
+    void printStatistics(ostream & out) const {
+      out << " cache: size = " << size() << " / " << capacity() << " hits = " << mHits
+        << " misses = " << mMisses << " hit rate = " << hitRate()
+        << " invalidations = " << mInvalidations << " evictions = " << mEvictions << endl;
+    }
+
+  protected:
+    struct Key {
+      Key(const RangedCubicPolynomial & f) : start(f.mStart), end(f.mEnd),
+        a0(f.mA0), a1(f.mA1), a2(f.mA2), a3(f.mA3) {}
+      bool operator<(const Key & o) const {
+        if(start != o.start) return start < o.start;
+        if(end != o.end) return end < o.end;
+        if(a0 != o.a0) return a0 < o.a0;
+        if(a1 != o.a1) return a1 < o.a1;
+        if(a2 != o.a2) return a2 < o.a2;
+        return a3 < o.a3;
+      }
+      int64 start, end;
+      float a0, a1, a2, a3;
+    };
+
+    struct Entry {
+      float answer;
+      pair<int64,int64> dependency;
+      typename list<Key>::iterator recency;
+    };
+
+    OlaBuffer<DataType, Statistics> & mOB;
+    uint mCapacity;
+    map<Key, Entry> mEntries;
+    list<Key> mRecency; // most recently used first
+    uint64 mHits, mMisses, mInvalidations, mEvictions;
+};
+
+#endif
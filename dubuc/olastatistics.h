@@ -0,0 +1,133 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef OLASTATISTICS_H
+#define OLASTATISTICS_H
+
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+typedef long long int64;
+typedef unsigned long long uint64;
+
+/*
+ * Statistics policies for OlaBuffer (second template parameter).
+ *
+ * OlaBuffer calls the hooks below from query, updateBuffer and computeBuffer.
+ * The default policy, NoOlaStatistics, has empty inline hooks, so that the
+ * counting is compiled out entirely. Use OlaStatistics to count:
+ *
+ *  OlaBuffer< float, OlaStatistics > ob(b,N);
+ *  ob.query(rcp, data, *buffer);
+ *  OlaCounters c = ob.statistics().snapshot();
+ *  ob.statistics().reset();
+ *
+ * Levels are numbered as in the query loop: level 0 is the data itself,
+ * level l >= 1 is the buffer at scale b^l, and the top-level block sum
+ * is counted at the last level.
+ */
+class NoOlaStatistics {
+  public:
+    inline void query() {}
+    inline void dataRead(const int64 /*index*/, const int /*elementsize*/) {}
+    inline void bufferRead(const int /*level*/) {}
+    inline void interpolation() {}
+    inline void update() {}
+    inline void updateDelta(const int /*level*/) {}
+    inline void bufferWrite() {}
+    inline void transformCell(const int /*level*/) {}
+};
+
+/*
+ * A plain copy of the counters, suitable for exporting as metrics.
+ */
+struct OlaCounters {
+  enum { MaxLevels = 64 };
+
+  OlaCounters() { memset(this, 0, sizeof(OlaCounters)); }
+
+  uint64 queries, dataReads, dataPagesTouched, bufferReads, interpolations;
+  uint64 updates, updateDeltas, bufferWrites;
+  uint64 transformCells;
+  uint64 readsPerLevel[MaxLevels]; // data reads at level 0, buffer reads above
+  uint64 deltasPerLevel[MaxLevels];
+  uint64 transformCellsPerLevel[MaxLevels];
+
+  void print(ostream & out) const {
+    out << " queries = " << queries << " data reads = " << dataReads
+      << " data pages = " << dataPagesTouched << " buffer reads = " << bufferReads
+      << " interpolations = " << interpolations << endl;
+    out << " updates = " << updates << " update deltas = " << updateDeltas
+      << " buffer writes = " << bufferWrites << " transform cells = " << transformCells << endl;
+    for(int l = 0; l < MaxLevels; ++l) {
+      if(readsPerLevel[l] + deltasPerLevel[l] + transformCellsPerLevel[l] == 0) continue;
+      out << " level " << l << ": reads = " << readsPerLevel[l] << " deltas = " << deltasPerLevel[l]
+        << " transform cells = " << transformCellsPerLevel[l] << endl;
+    }
+  }
+};
+
+/*
+ * Counts everything. Pages are counted per query (or per buffer computation)
+ * as the number of times the data page changes between two consecutive reads,
+ * which is the number of distinct pages for the contiguous windows that Ola
+ * reads; this is what an ExternalArray pays for.
+ *
+ * Not thread-safe (the counters are not atomic): use one OlaBuffer per thread
+ * if you count, and do not hand an OlaBuffer< ..., OlaStatistics > to an
+ * OlaQueryBatch or any other job of an OlaExecutor (see olaexecutor.h), whose
+ * threads would all share it.
+ */
+class OlaStatistics {
+  public:
+    OlaStatistics(const int PageBytes = 4096) : mPageBytes(PageBytes), mLastPage(-1) {}
+
+    inline void query() { ++mCounters.queries; mLastPage = -1; }
+    inline void dataRead(const int64 index, const int elementsize) {
+      ++mCounters.dataReads;
+      ++mCounters.readsPerLevel[0];
+      const int64 page = index * elementsize / mPageBytes;
+      if(page != mLastPage) { ++mCounters.dataPagesTouched; mLastPage = page; }
+    }
+    inline void bufferRead(const int level) {
+      ++mCounters.bufferReads;
+      ++mCounters.readsPerLevel[clamp(level)];
+    }
+    inline void interpolation() { ++mCounters.interpolations; }
+    inline void update() { ++mCounters.updates; }
+    inline void updateDelta(const int level) {
+      ++mCounters.updateDeltas;
+      ++mCounters.deltasPerLevel[clamp(level)];
+    }
+    inline void bufferWrite() { ++mCounters.bufferWrites; }
+    inline void transformCell(const int level) {
+      ++mCounters.transformCells;
+      ++mCounters.transformCellsPerLevel[clamp(level)];
+    }
+
+    OlaCounters snapshot() const { return mCounters; }
+    void reset() { mCounters = OlaCounters(); mLastPage = -1; }
+
+  protected:
+    static inline int clamp(const int level) {
+      return level < OlaCounters::MaxLevels ? level : OlaCounters::MaxLevels - 1;
+    }
+
+    OlaCounters mCounters;
+    int mPageBytes;
+    int64 mLastPage;
+};
+
+#endif
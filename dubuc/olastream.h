@@ -0,0 +1,154 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef OLASTREAM_H
+#define OLASTREAM_H
+
+#include <vector>
+#include <istream>
+#include <cassert>
+#include "olabuffer.h"
+
+using namespace std;
+
+/*
+ * Builds the data and its Ola buffer in a single pass over a stream of
+ * values (an in-process producer, or a binary file or pipe with ingest), so
+ * that each value is read once and written once, instead of writing the data
+ * and reading it all again in computeBuffer:
+ *
+ *  ExternalArray<float> data(n);  // n = ob.computeRecommendedPaddedLength(...)
+ *  vector<float> buffer(ob.bufferSize(n));
+ *  OlaStreamBuilder< float, ExternalArray<float>, vector<float> > builder(ob, n, data, buffer);
+ *  builder.ingest(cin);  // or builder.push(value) for each value
+ *  builder.finish();  // zero padding up to n, if the stream was shorter
+ *
+ * The length must be known in advance (the right boundary depends on it). The
+ * result is the same as computeBuffer. Each level of the transform has a
+ * frontier: its input cell i (a value for level 0, cell i of the level below
+ * otherwise) is used as soon as it is final, which happens once the level
+ * below has used its inputs up to (i + N) b (and at the end of the stream for
+ * the last 2N cells). Apart from the data and the buffer, which it writes to,
+ * the builder only keeps two counters per level.
+ */
+template <class DataType, class Storage, class Buffer, class Statistics = NoOlaStatistics>
+class OlaStreamBuilder {
+  public:
+    // thrown by ingest when the stream ends in the middle of a value
+    class TruncatedValueException {
+      public: TruncatedValueException() {}
+    };
+
+    OlaStreamBuilder(OlaBuffer<DataType, Statistics> & ob, const int64 n, Storage & data, Buffer & buffer)
+        throw(typename OlaBuffer<DataType, Statistics>::TooSmallException) :
+        mOB(ob), mB(ob.basis()), mN(ob.moments()), mLength(n), mData(data), mBuffer(buffer) {
+      assert((int64) data.size() >= n);
+      const int64 cells = ob.bufferSize(n);
+      assert((int64) buffer.size() >= cells);
+      if(cells < 2 * mN) throw typename OlaBuffer<DataType, Statistics>::TooSmallException();
+      for (int64 cell = 0; cell < cells; ++cell) buffer[cell] = 0;
+      // same levels as computeBuffer
+      const int levels = ob.correctionLevels(n);
+      int64 stride = 1;
+      for(int level = 0; level < levels; ++level) {
+        Level l;
+        l.stride = stride;
+        l.outstride = level == 0 ? 1 : mB * stride;
+        const int64 length = level == 0 ? n : cells;
+        l.inputs = (length - 1) / stride + 1;
+        l.outputs = length / (mB * stride) + 1;
+        l.used = 0;
+        mLevels.push_back(l);
+        if(level > 0) stride *= mB;
+      }
+    }
+
+    // the next value of the data
+    void push(const DataType value) {
+      assert(mLevels[0].used < mLength);
+      const int64 i = mLevels[0].used;
+      mData[i] = value;
+      mOB.transformCell(value, i, mBuffer, 1, mLevels[0].outputs, mLevels[0].inputs - 1, 0);
+      ++mLevels[0].used;
+      if((mLevels[0].used % mB == 0) || (mLevels[0].used == mLength)) advance();
+    }
+
+    void push(const DataType * values, const int64 count) {
+      for(int64 k = 0; k < count; ++k) push(values[k]);
+    }
+
+    /*
+     * Reads binary values until the end of the stream or until the array is
+     * full, and returns how many were read. If the stream ends with part of a
+     * value (a truncated file), the whole values before it are pushed, then
+     * TruncatedValueException is thrown.
+     */
+    int64 ingest(istream & in) throw(TruncatedValueException) {
+      const int64 start = position();
+      vector<DataType> block(BlockValues);
+      while((position() < mLength) && in) {
+        const int64 wanted = mLength - position() < (int64) BlockValues ? mLength - position() : (int64) BlockValues;
+        in.read((char *) & block[0], wanted * sizeof(DataType));
+        push(& block[0], in.gcount() / sizeof(DataType));
+        if(in.gcount() % sizeof(DataType) != 0) throw TruncatedValueException();
+      }
+      return position() - start;
+    }
+
+    // pads with zeros up to the length: afterwards the buffer is complete
+    void finish() {
+      while(position() < mLength) push(0);
+    }
+
+    // number of values pushed so far
+    inline int64 position() const { return mLevels[0].used; }
+    inline bool finished() const { return mLevels.back().used == mLevels.back().inputs; }
+
+  protected:
+    enum { BlockValues = 1 << 14 };
+
+    struct Level {
+      int64 stride, outstride;// input cell i is buffer[i * stride] (level > 0), output cell k is buffer[k * outstride]
+      int64 inputs, outputs;
+      int64 used;// inputs used so far
+    };
+
+    // output cell k of level l will not change anymore
+    inline bool final(const int l, const int64 k) const {
+      const Level & level = mLevels[l];
+      if(level.used == level.inputs) return true;
+      return (k + 2 * mN < level.outputs) && (level.used >= (k + mN) * mB);
+    }
+
+    // uses the inputs of the upper levels that became final
+    void advance() {
+      for(uint l = 1; l < mLevels.size(); ++l) {
+        Level & level = mLevels[l];
+        while((level.used < level.inputs) && final(l - 1, level.used)) {
+          const int64 i = level.used;
+          mOB.transformCell(mBuffer[i * level.stride], i, mBuffer, level.outstride, level.outputs,
+              level.inputs - 1, l);
+          ++level.used;
+        }
+      }
+    }
+
+    OlaBuffer<DataType, Statistics> & mOB;
+    int mB, mN;
+    int64 mLength;
+    Storage & mData;
+    Buffer & mBuffer;
+    vector<Level> mLevels;
+};
+
+#endif
@@ -0,0 +1,207 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef OLATUNER_H
+#define OLATUNER_H
+
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include "olabuffer.h"
+#include "latencyhistogram.h"
+
+using namespace std;
+
+/*
+ * Chooses the basis b of an OlaBuffer for a given array length, buffer memory
+ * budget and workload.
+ *
+ * The cost model follows the loops of OlaBuffer:
+ *
+ *  - a query walks every level (the data, then the buffer at scales b, b^2, ...)
+ *    and, at each level, visits two boundary windows of about 2N b cells, each
+ *    cell costing one interpolation (2N terms); it then sums the top level
+ *    over (end-start)/scale cells (we assume ranges of length n/3 on average);
+ *    on external data, the two data windows cost one page read each plus one
+ *    per page they span;
+ *  - an update propagates about 2N deltas to 2N cells at each of the levels.
+ *
+ * The unit costs default to values typical of a recent x86 box, and can be
+ * measured on the current machine with calibrate() (a fraction of a second).
+ *
+ *  OlaTuner<float> tuner(2);
+ *  tuner.calibrate();
+ *  OlaTuner<float>::Recommendation r = tuner.recommend(n, 64 << 20, 0.9, false);
+ *  OlaBuffer<float> ob(r.b, r.N);  // pad the data to r.paddedLength
+ *
+ * N is an input and not tuned: it is fixed by the degree of the polynomials
+ * you need to query (degree <= 2N-1).
+ */
+template <class DataType>
+class OlaTuner {
+  public:
+
+    // unit costs in nanoseconds
+    struct CostModel {
+      CostModel() : nsPerInterpolationTerm(1.5), nsPerBlockCell(1.5),
+        nsPerUpdateTerm(25.0), nsPerExternalPage(100000.0), pageBytes(4096) {}
+      double nsPerInterpolationTerm, nsPerBlockCell, nsPerUpdateTerm, nsPerExternalPage;
+      int pageBytes;
+    };
+
+    struct Recommendation {
+      int b, N, levels;
+      int64 paddedLength, bufferLength;
+      uint64 bufferBytes;
+      double queryNs, updateNs, costNs;// predicted, costNs is per operation of the mix
+
+      void print(ostream & out) const {
+        out << " recommended b = " << b << " (N = " << N << ", levels = " << levels << ")" << endl;
+        out << " padded length = " << paddedLength << ", buffer = " << bufferLength
+          << " cells (" << bufferBytes / (1024.0 * 1024.0) << " MB)" << endl;
+        out << " predicted query = " << queryNs << " ns, update = " << updateNs
+          << " ns, per operation = " << costNs << " ns" << endl;
+      }
+    };
+
+    // thrown when no basis fits in the memory budget
+    class NoFeasibleBasisException {
+      public: NoFeasibleBasisException() {}
+    };
+
+    OlaTuner(int N, CostModel cm = CostModel()) : mN(N), mCost(cm) { assert(N > 0); }
+
+    const CostModel & costModel() const { return mCost; }
+
+    /*
+     * Length is the array length (before padding), MemoryBudget the number of
+     * bytes we can spend on the buffer, QueryFraction the fraction of operations
+     * that are queries (1.0 = read-only, 0.0 = update-only), External is true
+     * if the data lives on disk (ExternalArray).
+     */
+    Recommendation recommend(const int64 Length, const uint64 MemoryBudget,
+        const double QueryFraction, const bool External) const throw(NoFeasibleBasisException) {
+      assert(Length > 1);
+      assert(QueryFraction >= 0.0 && QueryFraction <= 1.0);
+      vector<int> candidates = candidateBases(Length);
+      bool found = false;
+      Recommendation best;
+      for(uint k = 0; k < candidates.size(); ++k) {
+        Recommendation r = evaluate(candidates[k], Length, QueryFraction, External);
+        if(r.bufferBytes > MemoryBudget) continue;
+        if(!found || (r.costNs < best.costNs)) { best = r; found = true; }
+      }
+      if(!found) throw NoFeasibleBasisException();
+      return best;
+    }
+
+    /*
+     * Cost model for one basis.
+     */
+    Recommendation evaluate(const int b, const int64 Length, const double QueryFraction,
+        const bool External) const {
+      OlaBuffer<DataType> ob(b, mN);
+      Recommendation r;
+      r.b = b; r.N = mN;
+      r.paddedLength = ob.computeRecommendedPaddedLength(Length);
+      r.bufferLength = r.paddedLength / b + 1;
+      r.bufferBytes = r.bufferLength * sizeof(DataType);
+      r.levels = ob.levels(r.paddedLength);
+      r.queryNs = predictQueryNs(b, r.paddedLength, External);
+      r.updateNs = predictUpdateNs(b, r.paddedLength);
+      r.costNs = QueryFraction * r.queryNs + (1.0 - QueryFraction) * r.updateNs;
+      return r;
+    }
+
+    double predictQueryNs(const int b, const int64 PaddedLength, const bool External) const {
+      double terms, blockcells;
+      queryWork(b, PaddedLength, terms, blockcells);
+      double answer = terms * mCost.nsPerInterpolationTerm + blockcells * mCost.nsPerBlockCell;
+      if(External) {
+        const double windowbytes = 2.0 * mN * b * sizeof(DataType);
+        answer += 2 * (windowbytes / mCost.pageBytes + 1) * mCost.nsPerExternalPage;
+      }
+      return answer;
+    }
+
+    double predictUpdateNs(const int b, const int64 PaddedLength) const {
+      return updateWork(b, PaddedLength) * mCost.nsPerUpdateTerm;
+    }
+
+    /*
+     * Measures the in-memory unit costs with short runs on this machine
+     * (nsPerExternalPage is left alone: set it from your own device).
+     */
+    void calibrate(const int Trials = 2000) {
+      const int b = 16;
+      OlaBuffer<DataType> ob(b, mN);
+      const int64 n = ob.computeRecommendedPaddedLength(1 << 18);
+      vector<DataType> data(n);
+      srand(1234);
+      for(int64 k = 0; k < n; ++k) data[k] = (DataType) (rand() / (double) RAND_MAX);
+      counted_ptr<vector<DataType> > buffer = ob.computeBuffer(data);
+      double terms, blockcells;
+      queryWork(b, n, terms, blockcells);
+      float sink = 0.0f;
+      uint64 start = monotonicNanoseconds();
+      for(int t = 0; t < Trials; ++t) {
+        int64 x1 = (int64) (rand() / ((double) RAND_MAX) * n);
+        int64 x2 = (int64) (rand() / ((double) RAND_MAX) * n);
+        RangedCubicPolynomial rcp(1, 0, 0, 0, x1 < x2 ? x1 : x2, x1 < x2 ? x2 : x1);
+        sink += ob.query(rcp, data, *buffer);
+      }
+      const double perquery = (monotonicNanoseconds() - start) / (double) Trials;
+      mCost.nsPerInterpolationTerm = mCost.nsPerBlockCell = perquery / (terms + blockcells);
+      start = monotonicNanoseconds();
+      for(int t = 0; t < Trials; ++t)
+        ob.updateBuffer(*buffer, (int64) (rand() / ((double) RAND_MAX) * (n - 1)), 1.0f);
+      const double perupdate = (monotonicNanoseconds() - start) / (double) Trials;
+      mCost.nsPerUpdateTerm = perupdate / updateWork(b, n);
+      if(sink == 12345.0f) cout << endl; // keep the queries from being optimized away
+    }
+
+  protected:
+
+    // powers of two and three halves of powers of two, as long as the buffer has 2N cells
+    vector<int> candidateBases(const int64 Length) const {
+      vector<int> answer;
+      for(int64 b = 2; b < Length; b *= 2) {
+        if(b > (1 << 30)) break;
+        if(Length / b + 1 >= 2 * mN) answer.push_back((int) b);
+        const int64 b2 = b + b / 2;
+        if((b2 > b) && (b2 < Length) && (Length / b2 + 1 >= 2 * mN)) answer.push_back((int) b2);
+      }
+      return answer;
+    }
+
+    // mirrors the loops of OlaBuffer::query
+    void queryWork(const int b, const int64 n, double & terms, double & blockcells) const {
+      const double windowcells = 2.0 * mN * b;
+      int64 scale = b;
+      int boundarylevels = 1;// the data itself
+      for(; (n / (b * scale) + 1 >= 2 * mN) && (b * scale > 0); scale *= b) ++boundarylevels;
+      terms = boundarylevels * 2 * windowcells * 2 * mN;
+      blockcells = n / 3.0 / scale;
+    }
+
+    // mirrors the loops of OlaBuffer::updateBuffer
+    double updateWork(const int b, const int64 n) const {
+      OlaBuffer<DataType> ob(b, mN);
+      return (ob.levels(n) + 1) * 4.0 * mN * mN;
+    }
+
+    int mN;
+    CostModel mCost;
+};
+
+#endif
@@ -0,0 +1,179 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef POLYNOMIALFIT_H
+#define POLYNOMIALFIT_H
+
+#include <vector>
+#include <cmath>
+#include <cassert>
+#include "olabuffer.h"
+#include "cubicpolynomial.h"
+
+using namespace std;
+
+/*
+ * The function ((x - center) / halfwidth)^degree over [Start, End).
+ */
+class ScaledMonomial : public RangedFunction {
+  public:
+    ScaledMonomial(int Degree, double Center, double HalfWidth, int64 Start, int64 End) :
+      RangedFunction(Start, End), mDegree(Degree), mCenter(Center), mInverseHalfWidth(1.0 / HalfWidth) {}
+    virtual ~ScaledMonomial() {}
+    inline float operator()(const int64& x) const {
+      if((x < mStart) || (x >= mEnd)) return 0.0f;
+      const float u = (float) ((x - mCenter) * mInverseHalfWidth);
+      float answer = 1.0f;
+      for(int k = 0; k < mDegree; ++k) answer *= u;
+      return answer;
+    }
+    int mDegree;
+    double mCenter, mInverseHalfWidth;
+};
+
+/*
+ * A least-squares polynomial over [start, end), in the centered and scaled
+ * variable u = (x - center) / halfwidth which goes from -1 to 1 over the range:
+ *
+ *  p(x) = coefficient[0] + coefficient[1] u + ... + coefficient[degree] u^degree
+ */
+struct PolynomialFit {
+  enum { MaxDegree = 3 };
+  int degree;
+  double center, halfwidth;
+  double coefficient[MaxDegree + 1];
+
+  inline double operator()(const double x) const {
+    const double u = (x - center) / halfwidth;
+    double answer = 0.0;
+    for(int k = degree; k >= 0; --k) answer = answer * u + coefficient[k];
+    return answer;
+  }
+};
+
+/*
+ * Local least-squares fits of the data by polynomials of degree at most 2N - 1
+ * (and at most 3), using the Ola buffer:
+ *
+ *  PolynomialFitter< float, vector<float> > fitter(ob, data, *buffer);
+ *  PolynomialFit p = fitter.fit(start, end, 2);  // best parabola over [start, end)
+ *  double smoothed = p(x);
+ *
+ * The normal equations sum_j c_j sum_x u^(i+j) = sum_x u^i data[x] involve the
+ * 2 degree + 1 index moments, which only depend on the range and are computed
+ * in closed form, and the degree + 1 data moments, which we get in a single
+ * traversal of the levels (the multi-function OlaBuffer::query). We work in the
+ * variable u in [-1, 1] so that the (Hankel) system stays well conditioned, and
+ * solve it in double by Gaussian elimination with partial pivoting. The cost is
+ * that of one query, O(b log_b n), whatever the length of the range.
+ */
+template <class DataType, class Container, class Statistics = NoOlaStatistics>
+class PolynomialFitter {
+  public:
+    // thrown if the degree is too high for N, or the range has no more than degree values
+    class InvalidFitException {
+      public: InvalidFitException() {}
+    };
+
+    PolynomialFitter(const OlaBuffer<DataType, Statistics> & ob, const Container & data,
+        vector<DataType> & buffer) : mOB(ob), mData(data), mBuffer(buffer) {}
+
+    PolynomialFit fit(const int64 start, const int64 end, const int degree) const throw(InvalidFitException) {
+      if((degree < 0) || (degree > PolynomialFit::MaxDegree) || (degree > 2 * mOB.moments() - 1))
+        throw InvalidFitException();
+      if(end - start <= degree) throw InvalidFitException();
+      const int size = degree + 1;
+      PolynomialFit answer;
+      answer.degree = degree;
+      answer.center = (start + end - 1) / 2.0;
+      answer.halfwidth = end - start > 1 ? (end - start - 1) / 2.0 : 1.0;
+      // data moments, in one traversal
+      vector<ScaledMonomial> monomials;
+      for(int k = 0; k < size; ++k)
+        monomials.push_back(ScaledMonomial(k, answer.center, answer.halfwidth, start, end));
+      RangedFunction * functions[PolynomialFit::MaxDegree + 1];
+      for(int k = 0; k < size; ++k) functions[k] = & monomials[k];
+      float datamoments[PolynomialFit::MaxDegree + 1];
+      mOB.query(functions, size, mData, mBuffer, datamoments);
+      // index moments and the normal equations
+      double indexmoments[2 * PolynomialFit::MaxDegree + 1];
+      indexMoments(end - start, 2 * degree, indexmoments);
+      double system[PolynomialFit::MaxDegree + 1][PolynomialFit::MaxDegree + 2];
+      for(int i = 0; i < size; ++i) {
+        for(int j = 0; j < size; ++j) system[i][j] = indexmoments[i + j];
+        system[i][size] = datamoments[i];
+      }
+      solve(system, size, answer.coefficient);
+      for(int k = size; k <= PolynomialFit::MaxDegree; ++k) answer.coefficient[k] = 0.0;
+      return answer;
+    }
+
+    /*
+     * The sums of u^k for k = 0..maxk over the Length integers of a range, with
+     * u = (x - center) / halfwidth as in fit: sums of (t - (Length - 1) / 2)^k
+     * for 0 <= t < Length (zero when k is odd, by symmetry) scaled by halfwidth^k.
+     */
+    static void indexMoments(const int64 Length, const int maxk, double * moments) {
+      const double L = (double) Length;
+      const double c = - (L - 1) / 2.0;
+      const double halfwidth = Length > 1 ? (L - 1) / 2.0 : 1.0;
+      // power sums P_j = sum of t^j over 0 <= t < L, from sum (t+1)^(j+1) - t^(j+1) = L^(j+1)
+      double powersums[2 * PolynomialFit::MaxDegree + 1];
+      for(int j = 0; j <= maxk; ++j) {
+        double sum = pow(L, j + 1), binomial = 1.0;// C(j+1, i)
+        for(int i = 0; i < j; ++i) {
+          sum -= binomial * powersums[i];
+          binomial = binomial * (j + 1 - i) / (i + 1);
+        }
+        powersums[j] = sum / (j + 1);
+      }
+      for(int k = 0; k <= maxk; ++k) {
+        if(k % 2 == 1) { moments[k] = 0.0; continue; }
+        double sum = 0.0, binomial = 1.0;// C(k, j)
+        for(int j = 0; j <= k; ++j) {
+          sum += binomial * pow(c, k - j) * powersums[j];
+          binomial = binomial * (k - j) / (j + 1);
+        }
+        moments[k] = sum / pow(halfwidth, k);
+      }
+    }
+
+  protected:
+    // Gaussian elimination with partial pivoting on the augmented matrix
+    static void solve(double system[][PolynomialFit::MaxDegree + 2], const int size, double * solution)
+        throw(InvalidFitException) {
+      for(int col = 0; col < size; ++col) {
+        int pivot = col;
+        for(int row = col + 1; row < size; ++row)
+          if(fabs(system[row][col]) > fabs(system[pivot][col])) pivot = row;
+        if(system[pivot][col] == 0.0) throw InvalidFitException();
+        if(pivot != col)
+          for(int k = col; k <= size; ++k) swap(system[pivot][k], system[col][k]);
+        for(int row = col + 1; row < size; ++row) {
+          const double factor = system[row][col] / system[col][col];
+          for(int k = col; k <= size; ++k) system[row][k] -= factor * system[col][k];
+        }
+      }
+      for(int row = size - 1; row >= 0; --row) {
+        double value = system[row][size];
+        for(int k = row + 1; k < size; ++k) value -= system[row][k] * solution[k];
+        solution[row] = value / system[row][row];
+      }
+    }
+
+    const OlaBuffer<DataType, Statistics> & mOB;
+    const Container & mData;
+    vector<DataType> & mBuffer;
+};
+
+#endif
@@ -0,0 +1,99 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef POLYNOMIALOVERLAY_H
+#define POLYNOMIALOVERLAY_H
+
+#include <vector>
+#include <cassert>
+
+using namespace std;
+typedef long long int64;
+typedef unsigned long long uint64;
+
+/*
+ * A container (the data, or an Ola buffer) seen with polynomials added on top
+ * of it: each term adds p(k) to the cells k * stride for begin <= k < end,
+ * where p is given by its coefficients (constant first). This is what
+ * OlaBuffer::updateRange writes to, so that adding a polynomial to a range of
+ * the data costs a few terms instead of one write per cell:
+ *
+ *  PolynomialOverlay< float > dataview(data), bufferview(*buffer);
+ *  ob.updateRange(dataview, bufferview, rcp);  // data += rcp over [rcp.mStart, rcp.mEnd)
+ *  ob.query(f, dataview, bufferview);  // same as with the updated data and buffer
+ *  dataview.materialize(); bufferview.materialize();  // once there are too many terms
+ *
+ * Reading a cell costs one test per term. Only reads go through the overlay;
+ * other writes (updateBuffer, say) go to base(), which is correct since the
+ * terms are added on top of whatever it holds.
+ */
+template <class DataType, class Storage = vector<DataType> >
+class PolynomialOverlay {
+  public:
+    struct Term {
+      int64 begin, end, stride;
+      vector<double> coefficients;
+      inline double operator()(const int64 k) const {
+        double answer = 0;
+        for(int j = coefficients.size() - 1; j >= 0; --j) answer = answer * k + coefficients[j];
+        return answer;
+      }
+    };
+
+    PolynomialOverlay(Storage & base) : mBase(base) {}
+    virtual ~PolynomialOverlay() {}
+
+    inline DataType operator[](const uint64 pos) const {
+      double answer = mBase[pos];
+      for(uint64 t = 0; t < mTerms.size(); ++t) {
+        const Term & term = mTerms[t];
+        const int64 k = (int64) pos / term.stride;
+        if((k >= term.begin) && (k < term.end) && (k * term.stride == (int64) pos)) answer += term(k);
+      }
+      return (DataType) answer;
+    }
+    inline uint64 size() const { return mBase.size(); }
+
+    // adds p(k) to the cells k * stride for begin <= k < end
+    void addTerm(const int64 begin, const int64 end, const int64 stride, const vector<double> & coefficients) {
+      assert(stride > 0);
+      assert(begin >= 0);
+      assert((end - 1) * stride < (int64) mBase.size());
+      if(begin >= end) return;
+      Term term;
+      term.begin = begin;
+      term.end = end;
+      term.stride = stride;
+      term.coefficients = coefficients;
+      mTerms.push_back(term);
+    }
+
+    // writes the terms to the container and forgets them
+    void materialize() {
+      for(uint64 t = 0; t < mTerms.size(); ++t) {
+        const Term & term = mTerms[t];
+        for(int64 k = term.begin; k < term.end; ++k) mBase[k * term.stride] += term(k);
+      }
+      mTerms.clear();
+    }
+
+    uint64 terms() const { return mTerms.size(); }
+    Storage & base() { return mBase; }
+    const Storage & base() const { return mBase; }
+
+  protected:
+    Storage & mBase;
+    vector<Term> mTerms;
+};
+
+#endif
@@ -0,0 +1,234 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef RANGEENGINES_H
+#define RANGEENGINES_H
+
+#include <vector>
+#include <cstring>
+#include "olabuffer.h"
+#include "counted_ptr.h"
+#include "cubicpolynomial.h"
+
+using namespace std;
+
+/*
+ * Interchangeable engines answering the same polynomial range queries
+ * (scalar product of a RangedCubicPolynomial with the data) and point updates
+ * (data[pos] += change), so that Ola can be benchmarked side by side with
+ * the usual alternatives:
+ *
+ *  OlaEngine          Ola buffer, O(b log_b n) query and update, n/b memory
+ *  PrefixSumEngine    prefix sums of the moments x^k data[x], O(1) query, O(n) update
+ *  FenwickEngine      one Fenwick tree per moment, O(log n) query and update
+ *  SimdScanEngine     no precomputation, vectorized scan, O(end-start) query
+ *
+ * Each engine works on a vector it is given (and modifies it on updates);
+ * memoryBytes() is the extra storage beyond that vector.
+ *
+ * The prefix-sum and Fenwick engines store the moments in double, but the
+ * cubic moments of a long array are large (n^4/4) so that their differences
+ * lose absolute precision on high-degree queries. Ola does not have this problem.
+ */
+template <class DataType>
+class RangeQueryEngine {
+  public:
+    virtual ~RangeQueryEngine() {}
+    virtual const char * name() const = 0;
+    virtual void build(vector<DataType> & data) = 0;
+    virtual float query(RangedCubicPolynomial & f) = 0;
+    virtual void update(const int64 pos, const DataType change) = 0;
+    virtual uint64 memoryBytes() const = 0;
+};
+
+template <class DataType>
+class OlaEngine : public RangeQueryEngine<DataType> {
+  public:
+    OlaEngine(int b, int N) : mOB(b,N), mData(0) {}
+    virtual ~OlaEngine() {}
+    virtual const char * name() const { return "ola"; }
+    virtual void build(vector<DataType> & data) {
+      mData = & data;
+      mBuffer = mOB.computeBuffer(data);
+    }
+    virtual float query(RangedCubicPolynomial & f) { return mOB.query(f, *mData, *mBuffer); }
+    virtual void update(const int64 pos, const DataType change) {
+      (*mData)[pos] += change;
+      mOB.updateBuffer(*mBuffer, pos, change);
+    }
+    virtual uint64 memoryBytes() const { return mBuffer->size() * sizeof(DataType); }
+
+  protected:
+    OlaBuffer<DataType> mOB;
+    vector<DataType> * mData;
+    counted_ptr<vector<DataType> > mBuffer;
+};
+
+template <class DataType>
+class PrefixSumEngine : public RangeQueryEngine<DataType> {
+  public:
+    enum { Moments = 4 };
+    PrefixSumEngine() : mData(0) {}
+    virtual ~PrefixSumEngine() {}
+    virtual const char * name() const { return "prefixsum"; }
+    virtual void build(vector<DataType> & data) {
+      mData = & data;
+      for(int k = 0; k < Moments; ++k) {
+        mPrefix[k].assign(data.size() + 1, 0.0);
+        double total = 0.0;
+        for(uint64 x = 0; x < data.size(); ++x) {
+          total += power(x, k) * data[x];
+          mPrefix[k][x + 1] = total;
+        }
+      }
+    }
+    virtual float query(RangedCubicPolynomial & f) {
+      const double a[Moments] = {f.mA0, f.mA1, f.mA2, f.mA3};
+      double sum = 0.0;
+      for(int k = 0; k < Moments; ++k)
+        if(a[k] != 0) sum += a[k] * (mPrefix[k][f.mEnd] - mPrefix[k][f.mStart]);
+      return (float) sum;
+    }
+    virtual void update(const int64 pos, const DataType change) {
+      (*mData)[pos] += change;
+      for(int k = 0; k < Moments; ++k) {
+        const double delta = power(pos, k) * change;
+        for(uint64 x = pos + 1; x < mPrefix[k].size(); ++x) mPrefix[k][x] += delta;
+      }
+    }
+    virtual uint64 memoryBytes() const { return Moments * mPrefix[0].size() * sizeof(double); }
+
+  protected:
+    static inline double power(const double x, const int k) {
+      double answer = 1.0;
+      for(int i = 0; i < k; ++i) answer *= x;
+      return answer;
+    }
+    vector<DataType> * mData;
+    vector<double> mPrefix[Moments];
+};
+
+template <class DataType>
+class FenwickEngine : public RangeQueryEngine<DataType> {
+  public:
+    enum { Moments = 4 };
+    FenwickEngine() : mData(0) {}
+    virtual ~FenwickEngine() {}
+    virtual const char * name() const { return "fenwick"; }
+    virtual void build(vector<DataType> & data) {
+      mData = & data;
+      const uint64 n = data.size();
+      for(int k = 0; k < Moments; ++k) {
+        mTree[k].assign(n + 1, 0.0);
+        // linear-time construction: push each node into its parent
+        for(uint64 i = 1; i <= n; ++i) {
+          mTree[k][i] += power(i - 1, k) * data[i - 1];
+          const uint64 parent = i + (i & (~i + 1));
+          if(parent <= n) mTree[k][parent] += mTree[k][i];
+        }
+      }
+    }
+    virtual float query(RangedCubicPolynomial & f) {
+      const double a[Moments] = {f.mA0, f.mA1, f.mA2, f.mA3};
+      double sum = 0.0;
+      for(int k = 0; k < Moments; ++k)
+        if(a[k] != 0) sum += a[k] * (prefix(k, f.mEnd) - prefix(k, f.mStart));
+      return (float) sum;
+    }
+    virtual void update(const int64 pos, const DataType change) {
+      (*mData)[pos] += change;
+      for(int k = 0; k < Moments; ++k) {
+        const double delta = power(pos, k) * change;
+        for(uint64 i = pos + 1; i < mTree[k].size(); i += i & (~i + 1)) mTree[k][i] += delta;
+      }
+    }
+    virtual uint64 memoryBytes() const { return Moments * mTree[0].size() * sizeof(double); }
+
+  protected:
+    // sum of the moment k over [0, end)
+    inline double prefix(const int k, uint64 end) const {
+      double answer = 0.0;
+      for(; end > 0; end -= end & (~end + 1)) answer += mTree[k][end];
+      return answer;
+    }
+    static inline double power(const double x, const int k) {
+      double answer = 1.0;
+      for(int i = 0; i < k; ++i) answer *= x;
+      return answer;
+    }
+    vector<DataType> * mData;
+    vector<double> mTree[Moments];
+};
+
+typedef float v8sf __attribute__ ((vector_size (32)));
+
+/*
+ * The naive scan, eight lanes at a time (GCC vector extensions, compiled to
+ * SSE or AVX depending on -march). The polynomial is re-centered on each block
+ * of 2^20 values so that the lane offsets stay exact in float.
+ */
+template <class DataType>
+class SimdScanEngine : public RangeQueryEngine<DataType> {
+  public:
+    SimdScanEngine() : mData(0) {}
+    virtual ~SimdScanEngine() {}
+    virtual const char * name() const { return "simdscan"; }
+    virtual void build(vector<DataType> & data) { mData = & data; }
+    virtual float query(RangedCubicPolynomial & f) {
+      const DataType * data = mData->empty() ? 0 : & (*mData)[0];
+      float sum = 0.0f;
+      for(int64 block = f.mStart; block < f.mEnd; block += BlockLength) {
+        const int64 blockend = block + BlockLength < f.mEnd ? block + BlockLength : f.mEnd;
+        sum += scanBlock(f, block, blockend, data);
+      }
+      return sum;
+    }
+    virtual void update(const int64 pos, const DataType change) { (*mData)[pos] += change; }
+    virtual uint64 memoryBytes() const { return 0; }
+
+  protected:
+    enum { BlockLength = 1 << 20, Lanes = 8 };
+
+    // sum over [start, end) of q(x - start) data[x] with q(t) = f(t + start)
+    static float scanBlock(const CubicPolynomial & f, const int64 start, const int64 end,
+        const DataType * data) {
+      const double c = (double) start;
+      const float q0 = (float) (f.mA0 + c * (f.mA1 + c * (f.mA2 + c * f.mA3)));
+      const float q1 = (float) (f.mA1 + c * (2 * f.mA2 + 3 * c * f.mA3));
+      const float q2 = (float) (f.mA2 + 3 * c * f.mA3);
+      const float q3 = f.mA3;
+      const v8sf vq0 = {q0,q0,q0,q0,q0,q0,q0,q0}, vq1 = {q1,q1,q1,q1,q1,q1,q1,q1},
+        vq2 = {q2,q2,q2,q2,q2,q2,q2,q2}, vq3 = {q3,q3,q3,q3,q3,q3,q3,q3};
+      const v8sf step = {Lanes,Lanes,Lanes,Lanes,Lanes,Lanes,Lanes,Lanes};
+      v8sf t = {0,1,2,3,4,5,6,7};
+      v8sf acc = {0,0,0,0,0,0,0,0};
+      int64 x = start;
+      for(; x + Lanes <= end; x += Lanes) {
+        v8sf values;
+        for(int l = 0; l < Lanes; ++l) values[l] = (float) data[x + l];
+        acc += (vq0 + t * (vq1 + t * (vq2 + t * vq3))) * values;
+        t += step;
+      }
+      float sum = 0.0f;
+      for(int l = 0; l < Lanes; ++l) sum += acc[l];
+      for(; x < end; ++x) {
+        const float tt = (float) (x - start);
+        sum += (q0 + tt * (q1 + tt * (q2 + tt * q3))) * data[x];
+      }
+      return sum;
+    }
+
+    vector<DataType> * mData;
+};
+
+#endif
@@ -0,0 +1,208 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef SLIDINGMOMENTS_H
+#define SLIDINGMOMENTS_H
+
+#include <cassert>
+#include "olabuffer.h"
+#include "cubicpolynomial.h"
+
+using namespace std;
+
+/*
+ * The local moments of one window [start, start + W):
+ *
+ *  moment[k] = sum over 0 <= t < W of t^k data[start + t]
+ *
+ * (positions relative to the window start). Seeing the window as a
+ * distribution (a histogram for example), mean() and variance() are those of
+ * the position; average() is the average of the values.
+ *
+ * This is a plain struct so that it can be stored in an ExternalArray.
+ */
+struct WindowMoments {
+  enum { MaxMoments = 4 };
+  float moment[MaxMoments];
+
+  inline double sum() const { return moment[0]; }
+  inline double average(const int64 W) const { return moment[0] / (double) W; }
+  inline double mean() const { return moment[0] != 0 ? moment[1] / (double) moment[0] : 0.0; }
+  inline double variance() const {
+    if(moment[0] == 0) return 0.0;
+    const double m = mean();
+    return moment[2] / (double) moment[0] - m * m;
+  }
+};
+
+/*
+ * The function (x - origin)^degree over [origin, End), evaluated from the exact
+ * offset x - origin so that high moments far from 0 do not lose their precision
+ * in float as a RangedCubicPolynomial in x would.
+ */
+class ShiftedMonomial : public RangedFunction {
+  public:
+    ShiftedMonomial(int Degree, int64 Origin, int64 End) : RangedFunction(Origin, End), mDegree(Degree) {}
+    virtual ~ShiftedMonomial() {}
+    inline float operator()(const int64& x) const {
+      if((x < mStart) || (x >= mEnd)) return 0.0f;
+      const float t = (float) (x - mStart);
+      float answer = 1.0f;
+      for(int k = 0; k < mDegree; ++k) answer *= t;
+      return answer;
+    }
+    int mDegree;
+};
+
+/*
+ * Moments of every window [j s, j s + W) for j = 0, 1, ..., windows(n, W, s) - 1,
+ * written to out[j], in O(n) total instead of one query per window:
+ *
+ *  SlidingMoments sm(3);  // sum, first and second moments
+ *  vector<WindowMoments> out(sm.windows(data.size(), W, s));
+ *  sm.compute(data, W, s, out);
+ *  // out[j].average(W), out[j].mean(), out[j].variance()
+ *
+ * The data is read sequentially (two streams, W apart). Between two windows the
+ * moments are updated with the s values that leave and the s values that come
+ * in, then re-centered on the new start with the binomial formula; they are
+ * recomputed from scratch every W values to stop the rounding errors from
+ * accumulating, which reads the data a second time. When s >= W, each window is
+ * computed directly and the data between the windows is skipped.
+ *
+ * Given an Ola buffer of the data, compute(data, ob, buffer, W, s, out) uses
+ * queries instead whenever they are cheaper (long windows and large strides,
+ * and 2N - 1 at least the highest degree). The output can be any container
+ * with operator[] (for example ExternalArray<WindowMoments> for out-of-core
+ * sizes).
+ */
+class SlidingMoments {
+  public:
+    SlidingMoments(int Moments = 3) : mMoments(Moments) {
+      assert(Moments > 0); assert(Moments <= WindowMoments::MaxMoments);
+    }
+
+    int moments() const { return mMoments; }
+
+    // number of windows of length W with stride s fitting in n values
+    static int64 windows(const int64 n, const int64 W, const int64 s) {
+      assert(W > 0); assert(s > 0);
+      return n < W ? 0 : (n - W) / s + 1;
+    }
+
+    // sequential computation
+    template <class Container, class Output>
+    void compute(const Container& data, const int64 W, const int64 s, Output& out) const {
+      const int64 count = windows(data.size(), W, s);
+      if(count == 0) return;
+      double m[WindowMoments::MaxMoments];
+      int64 start = 0, fresh = 0;// fresh: values slid since the last recomputation
+      direct(data, start, W, m);
+      store(m, out[0]);
+      for(int64 j = 1; j < count; ++j) {
+        if((s >= W) || (fresh + s > W)) {
+          start += s;
+          direct(data, start, W, m);
+          fresh = 0;
+        } else {
+          // relative to the old start: drop [0, s), add [W, W + s)
+          for(int64 t = 0; t < s; ++t) accumulate(m, t, - (double) data[start + t]);
+          for(int64 t = W; t < W + s; ++t) accumulate(m, t, data[start + t]);
+          shift(m, s);
+          start += s;
+          fresh += s;
+        }
+        store(m, out[j]);
+      }
+    }
+
+    // uses the buffer instead when it is cheaper
+    template <class Container, class DataType, class Statistics, class Output>
+    void compute(const Container& data, const OlaBuffer<DataType, Statistics>& ob,
+        vector<DataType>& buffer, const int64 W, const int64 s, Output& out) const {
+      if(useBuffer(ob, data.size(), W, s)) computeWithBuffer(data, ob, buffer, W, s, out);
+      else compute(data, W, s, out);
+    }
+
+    /*
+     * Our cost model: a query walks the levels and reads two windows of about
+     * 2N b cells per level, each needing an interpolation of 2N terms; the
+     * sequential computation costs about 3 min(s, W) per window and moment.
+     */
+    template <class DataType, class Statistics>
+    bool useBuffer(const OlaBuffer<DataType, Statistics>& ob, const int64 n,
+        const int64 W, const int64 s) const {
+      const int b = ob.basis(), N = ob.moments();
+      if(2 * N - 1 < mMoments - 1) return false;// the queries would not be exact
+      const double querycost = (ob.levels(n) + 1) * 2.0 * (2 * N * b) * (2 * N);
+      const double sequentialcost = 3.0 * (s < W ? s : W);
+      return querycost < sequentialcost;
+    }
+
+    template <class Container, class DataType, class Statistics, class Output>
+    void computeWithBuffer(const Container& data, const OlaBuffer<DataType, Statistics>& ob,
+        vector<DataType>& buffer, const int64 W, const int64 s, Output& out) const {
+      const int64 count = windows(data.size(), W, s);
+      for(int64 j = 0; j < count; ++j) {
+        WindowMoments wm;
+        for(int k = 0; k < WindowMoments::MaxMoments; ++k) {
+          if(k >= mMoments) { wm.moment[k] = 0.0f; continue; }
+          ShiftedMonomial f(k, j * s, j * s + W);
+          wm.moment[k] = ob.query(f, data, buffer);
+        }
+        out[j] = wm;
+      }
+    }
+
+  protected:
+    template <class Container>
+    inline void direct(const Container& data, const int64 start, const int64 W, double * m) const {
+      for(int k = 0; k < mMoments; ++k) m[k] = 0.0;
+      for(int64 t = 0; t < W; ++t) accumulate(m, t, data[start + t]);
+    }
+
+    inline void accumulate(double * m, const int64 t, const double value) const {
+      double term = value;
+      for(int k = 0; k < mMoments; ++k) {
+        m[k] += term;
+        term *= t;
+      }
+    }
+
+    // from moments relative to some origin to moments relative to origin + s:
+    // sum (t - s)^k d = sum_i C(k,i) (-s)^(k-i) sum t^i d
+    inline void shift(double * m, const int64 s) const {
+      double shifted[WindowMoments::MaxMoments];
+      for(int k = 0; k < mMoments; ++k) {
+        double binomial = 1.0, power = 1.0;// C(k,i) and (-s)^(k-i), from i = k down
+        shifted[k] = 0.0;
+        for(int i = k; i >= 0; --i) {
+          shifted[k] += binomial * power * m[i];
+          binomial = binomial * i / (k - i + 1);
+          power *= - (double) s;
+        }
+      }
+      for(int k = 0; k < mMoments; ++k) m[k] = shifted[k];
+    }
+
+    template <class Element>
+    inline void store(const double * m, Element & e) const {
+      WindowMoments wm;
+      for(int k = 0; k < WindowMoments::MaxMoments; ++k) wm.moment[k] = k < mMoments ? (float) m[k] : 0.0f;
+      e = wm;
+    }
+
+    int mMoments;
+};
+
+#endif
@@ -0,0 +1,118 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef SPARSEARRAY_H
+#define SPARSEARRAY_H
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+typedef long long int64;
+typedef unsigned long long uint64;
+
+/*
+ * An array of the given size that is zero but for a few values, stored as a
+ * sorted list of (index, value) pairs. It reads in O(log nonzeros), which is
+ * fine for queries (they only read the data near the ends of the range), and
+ * its buffer is built from the list by OlaBuffer::computeSparseBuffer:
+ *
+ *  SparseArray< float > data(n, entries);  // sorted by index
+ *  SparseBuffer< float > buffer(ob.bufferSize(n));
+ *  ob.computeSparseBuffer(data.entries(), n, buffer);
+ *  ob.query(f, data, buffer);
+ *  data.add(pos, change); ob.updateBuffer(buffer, pos, change);
+ */
+template <class DataType>
+class SparseArray {
+  public:
+    typedef pair<int64, DataType> Entry;
+
+    SparseArray(const uint64 size) : mArraySize(size) {}
+    SparseArray(const uint64 size, const vector<Entry> & entries) : mArraySize(size), mEntries(entries) {
+      for(uint64 k = 1; k < mEntries.size(); ++k) assert(mEntries[k - 1].first < mEntries[k].first);
+      assert(mEntries.empty() || ((uint64) mEntries.back().first < size));
+    }
+    virtual ~SparseArray() {}
+
+    inline DataType operator[](const uint64 pos) const {
+      assert(pos < mArraySize);
+      typename vector<Entry>::const_iterator it = lower_bound(mEntries.begin(), mEntries.end(),
+          Entry((int64) pos, 0), ByIndex());
+      return (it != mEntries.end()) && ((uint64) it->first == pos) ? it->second : 0;
+    }
+    inline uint64 size() const { return mArraySize; }
+
+    // data[pos] += change: constant time at the end, linear in the nonzeros elsewhere
+    void add(const int64 pos, const DataType change) {
+      assert((uint64) pos < mArraySize);
+      if(mEntries.empty() || (mEntries.back().first < pos)) {
+        mEntries.push_back(Entry(pos, change));
+        return;
+      }
+      typename vector<Entry>::iterator it = lower_bound(mEntries.begin(), mEntries.end(), Entry(pos, 0), ByIndex());
+      if(it->first == pos) it->second += change;
+      else mEntries.insert(it, Entry(pos, change));
+    }
+
+    const vector<Entry> & entries() const { return mEntries; }
+    uint64 nonzeros() const { return mEntries.size(); }
+
+  protected:
+    struct ByIndex {
+      bool operator()(const Entry & a, const Entry & b) const { return a.first < b.first; }
+    };
+
+    uint64 mArraySize;
+    vector<Entry> mEntries;
+};
+
+/*
+ * A buffer that only stores the cells that were written (a map), to use
+ * with computeSparseBuffer, query and updateBuffer when the data is sparse:
+ * its memory grows with the nonzeros of the data (about 2N levels cells
+ * each, fewer when they are close to one another), not with its size.
+ *
+ * Reading a cell never stores it; writing one through the non-const
+ * operator[] does, even if it ends up zero.
+ */
+template <class DataType>
+class SparseBuffer {
+  public:
+    SparseBuffer(const uint64 size) : mArraySize(size) {}
+    virtual ~SparseBuffer() {}
+
+    inline DataType operator[](const uint64 pos) const {
+      assert(pos < mArraySize);
+      typename map<int64, DataType>::const_iterator it = mCells.find(pos);
+      return it == mCells.end() ? 0 : it->second;
+    }
+    inline DataType & operator[](const uint64 pos) {
+      assert(pos < mArraySize);
+      return mCells[pos];
+    }
+    inline uint64 size() const { return mArraySize; }
+
+    // number of cells stored
+    uint64 nonzeros() const { return mCells.size(); }
+    const map<int64, DataType> & cells() const { return mCells; }
+    void clear() { mCells.clear(); }
+
+  protected:
+    uint64 mArraySize;
+    map<int64, DataType> mCells;
+};
+
+#endif
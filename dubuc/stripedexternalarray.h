@@ -0,0 +1,186 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef STRIPEDEXTERNALARRAY_H
+#define STRIPEDEXTERNALARRAY_H
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <vector>
+#include <string>
+#include <cassert>
+
+using namespace std;
+typedef unsigned long long uint64;
+
+/*
+ * Same as ExternalArray, but spread over several files (one per device, say),
+ * in extents of ExtentSize values dealt round-robin: extent e is extent e / F
+ * of file e % F, for F files. A sequential scan (computeBuffer) thus reads all
+ * the devices in turn, and with load() or willNeed() all of them at once.
+ *
+ * vector<string> files;
+ * files.push_back("/mnt/nvme0/array"); files.push_back("/mnt/nvme1/array");
+ * StripedExternalArray<float> array(1000000000, files);
+ * array.load(0, array.size());  // one reader thread per file
+ * counted_ptr<vector<float> > buffer = ob.computeBuffer(array);
+ *
+ * ExtentSize must be a power of two, and the extent (in bytes) a multiple of
+ * the page size. As with ExternalArray, files that exist and are large enough
+ * are used as they are (so you can reopen an array), other files are extended
+ * (with zeroes) to the size they need, and the files are not removed.
+ *
+ * A safe copy constructor has not been implemented.
+ */
+template <class DataType>
+class StripedExternalArray {
+  public:
+    enum { DefaultExtentSize = 1 << 18 };
+
+    class CannotMapException {
+      public: CannotMapException() {}
+    };
+
+    StripedExternalArray(uint64 size, const vector<string> & FileNames,
+        uint64 ExtentSize = DefaultExtentSize) throw(CannotMapException) :
+        mArraySize(size), mExtentSize(ExtentSize), mExtentShift(0), mFileNames(FileNames) {
+      assert(FileNames.size() > 0);
+      assert((ExtentSize & (ExtentSize - 1)) == 0);
+      assert(ExtentSize * sizeof(DataType) % sysconf(_SC_PAGESIZE) == 0);
+      while(((uint64) 1 << mExtentShift) < ExtentSize) ++mExtentShift;
+      const uint64 filecount = FileNames.size();
+      const uint64 extents = (size + ExtentSize - 1) / ExtentSize;
+      for(uint64 f = 0; f < filecount; ++f) {
+        // file f holds the extents f, f + F, f + 2F...
+        const uint64 bytes = ((extents + filecount - 1 - f) / filecount) * ExtentSize * sizeof(DataType);
+        const int fd = ::open(FileNames[f].c_str(), O_RDWR | O_CREAT, 0644);
+        if(fd == -1) { release(); throw CannotMapException(); }
+        struct stat info;
+        if((fstat(fd, & info) != 0) || (((uint64) info.st_size < bytes) && (ftruncate(fd, bytes) != 0))) {
+          ::close(fd); release(); throw CannotMapException();
+        }
+        DataType * data = 0;
+        if(bytes > 0) {
+          void * map = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          if(map == MAP_FAILED) { ::close(fd); release(); throw CannotMapException(); }
+          data = (DataType *) map;
+        }
+        mFDs.push_back(fd);
+        mData.push_back(data);
+        mBytes.push_back(bytes);
+      }
+    }
+
+    virtual ~StripedExternalArray() { release(); }
+
+    inline const DataType & operator[](uint64 pos) const { return * address(pos); }
+    inline DataType & operator[](uint64 pos) { return * address(pos); }
+    virtual uint64 size() const { return mArraySize; }
+
+    uint64 files() const { return mData.size(); }
+    uint64 extentSize() const { return mExtentSize; }
+    const string & fileName(const uint64 f) const { return mFileNames[f]; }
+
+    /*
+     * Tells the kernel that [begin, end) will be needed soon, so that the
+     * reads start on all the files at once (madvise, returns immediately).
+     * Before a batch of queries, call it on their data dependencies (see
+     * OlaBuffer::dataDependency).
+     */
+    void willNeed(const uint64 begin, const uint64 end) const {
+      for(uint64 f = 0; f < files(); ++f) {
+        pair<uint64,uint64> local = localRange(f, begin, end);
+        if(local.first >= local.second) continue;
+        const uint64 page = sysconf(_SC_PAGESIZE);
+        const uint64 first = local.first * sizeof(DataType) / page * page;
+        madvise((char *) mData[f] + first, local.second * sizeof(DataType) - first, MADV_WILLNEED);
+      }
+    }
+
+    /*
+     * Reads [begin, end) into memory with one thread per file, and returns
+     * when it is all there.
+     */
+    void load(const uint64 begin, const uint64 end) const {
+      vector<Loader> loaders(files());
+      vector<pthread_t> threads(files());
+      vector<bool> started(files(), false);
+      for(uint64 f = 0; f < files(); ++f) {
+        pair<uint64,uint64> local = localRange(f, begin, end);
+        loaders[f].mBegin = (const char *) (mData[f] + local.first);
+        loaders[f].mEnd = (const char *) (mData[f] + (local.second > local.first ? local.second : local.first));
+        started[f] = pthread_create(& threads[f], 0, & Loader::run, & loaders[f]) == 0;
+        if(!started[f]) Loader::run(& loaders[f]);
+      }
+      for(uint64 f = 0; f < files(); ++f)
+        if(started[f]) pthread_join(threads[f], 0);
+    }
+
+    // the values [first, second) of file f that hold part of [begin, end) of the array
+    pair<uint64,uint64> localRange(const uint64 f, const uint64 begin, const uint64 end) const {
+      if(begin >= end) return pair<uint64,uint64>(0, 0);
+      const uint64 filecount = mData.size();
+      const uint64 firstextent = begin >> mExtentShift, lastextent = (end - 1) >> mExtentShift;
+      // first and last extents of file f within [firstextent, lastextent]
+      const uint64 first = firstextent + (f + filecount - firstextent % filecount) % filecount;
+      if(first > lastextent) return pair<uint64,uint64>(0, 0);
+      const uint64 last = lastextent - (lastextent % filecount + filecount - f) % filecount;
+      uint64 lower = (first / filecount) << mExtentShift, higher = ((last / filecount) + 1) << mExtentShift;
+      if(first == firstextent) lower += begin & (mExtentSize - 1);
+      if(last == lastextent) higher -= mExtentSize - 1 - ((end - 1) & (mExtentSize - 1));
+      return pair<uint64,uint64>(lower, higher);
+    }
+
+  protected:
+    inline DataType * address(const uint64 pos) const {
+      assert(pos < mArraySize);
+      const uint64 extent = pos >> mExtentShift;
+      const uint64 filecount = mData.size();
+      return mData[extent % filecount] + (((extent / filecount) << mExtentShift) | (pos & (mExtentSize - 1)));
+    }
+
+    // touches one byte per page, from the start of the page of mBegin (the maps are page aligned)
+    struct Loader {
+      const char * mBegin, * mEnd;
+      static void * run(void * arg) {
+        const Loader * l = (const Loader *) arg;
+        if(l->mBegin >= l->mEnd) return 0;
+        const long page = sysconf(_SC_PAGESIZE);
+        volatile char sink = 0;
+        for(const char * p = l->mBegin - (size_t) l->mBegin % page; p < l->mEnd; p += page) sink += *p;
+        return 0;
+      }
+    };
+
+    void release() {
+      for(uint64 f = 0; f < mData.size(); ++f) {
+        if(mData[f] != 0) munmap(mData[f], mBytes[f]);
+        ::close(mFDs[f]);
+      }
+      mData.clear(); mFDs.clear(); mBytes.clear();
+    }
+
+    uint64 mArraySize, mExtentSize;
+    int mExtentShift;
+    vector<string> mFileNames;
+    vector<int> mFDs;
+    vector<DataType *> mData;
+    vector<uint64> mBytes;
+};
+
+#endif
@@ -12,9 +12,30 @@
  */
 
 
+#include <sstream>
+#include <deque>
+#include "virtualarray.h"
 #include "externalarray.h"
 #include "olabuffer.h"
 #include "counted_ptr.h"
+#include "olatuner.h"
+#include "rangeengines.h"
+#include "olaquerycache.h"
+#include "olaprogressive.h"
+#include "minmaxpyramid.h"
+#include "slidingmoments.h"
+#include "polynomialfit.h"
+#include "arrayspan.h"
+#include "multiseriesbuffer.h"
+#include "bufferarena.h"
+#include "stripedexternalarray.h"
+#include "olastream.h"
+#include "checkpoint.h"
+#include "olaexecutor.h"
+#include "polynomialoverlay.h"
+#include "bufferalgebra.h"
+#include "sparsearray.h"
+#include "cachedexternalarray.h"
 
 
 /*
@@ -252,6 +273,1075 @@ void checkUpdate(int b, int N, int64 size, bool verbose = false) {
 
 
 
+/*
+ * Compares the buffer with one computed the slow way, each output of each
+ * level being the sum of its inputs weighted by the interpolation (from the
+ * output cells) of a delta, so that the boundaries of the upper levels,
+ * where the inputs are buffer cells rather than data, are checked too.
+ */
+void checkBoundaries(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing boundaries b = "<< b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) ((k * 7) % 11) - 4.5f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  vector<float> expected(buffer->size());
+  vector<float> inputs(data);
+  int64 outstride = 1;
+  for(int level = 0; (level == 0) || ((int64) inputs.size() / b + 1 >= 2 * N); ++level, outstride *= b) {
+    const int64 length = inputs.size();
+    vector<float> outputs(length / b + 1, 0.0f);
+    for(int64 k = 0; k < (int64) outputs.size(); ++k) {
+      RangedCubicPolynomial delta(1, 0, 0, 0, k * b, k * b + 1);
+      for(int64 i = 0; i < length; ++i) outputs[k] += ob.interpolate(i, 1, delta, length) * inputs[i];
+      expected[k * outstride] = outputs[k];
+    }
+    inputs = outputs;
+  }
+  for(int64 c = buffer->size() - 1; c >= 0; --c) 
+    if(fabs((*buffer)[c] - expected[c]) > 0.0001 * (1 + fabs(expected[c]))) {
+      cout << " cell " << c << " buffer = " << (*buffer)[c] << " expected = " << expected[c] << endl;
+      throw TestFailedException(c);
+    }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkTuner(int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing tuner N = " << N << " size = " << size << endl;
+  OlaTuner< float > tuner(N);
+  const uint64 budget = size; // bytes, so b must be at least 4 for floats
+  OlaTuner< float >::Recommendation readonly = tuner.recommend(size, budget, 1.0, false);
+  OlaTuner< float >::Recommendation writeonly = tuner.recommend(size, budget, 0.0, false);
+  if(verbose) { readonly.print(cout); writeonly.print(cout); }
+  OlaBuffer< float > ob(readonly.b, N);
+  if(readonly.paddedLength != ob.computeRecommendedPaddedLength(size)) throw TestFailedException(readonly.b);
+  if(readonly.paddedLength < size) throw TestFailedException(readonly.b);
+  if(readonly.bufferBytes > budget) throw TestFailedException(readonly.b);
+  if(writeonly.bufferBytes > budget) throw TestFailedException(writeonly.b);
+  // queries favor small bases, updates favor few levels
+  if(readonly.b > writeonly.b) throw TestFailedException(readonly.b);
+  vector<float> data(readonly.paddedLength, 1.0f);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  if((int64) buffer->size() != readonly.bufferLength) throw TestFailedException(buffer->size());
+  try {
+    tuner.recommend(size, 4, 1.0, false);
+    throw TestFailedException(0);
+  } catch (OlaTuner< float >::NoFeasibleBasisException & e) {}
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkStatistics(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing statistics b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float, OlaStatistics > ob(b,N);
+  vector<float> data(size, 1.0f);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  OlaCounters built = ob.statistics().snapshot();
+  if(built.transformCellsPerLevel[0] != (uint64) size) throw TestFailedException(built.transformCellsPerLevel[0]);
+  if(built.dataReads != (uint64) size) throw TestFailedException(built.dataReads);
+  ob.statistics().reset();
+  RangedCubicPolynomial rcp(1,0,0,0,size/3,2*size/3);
+  float answer = ob.query(rcp, data, *buffer);
+  if(abs(answer - (2*size/3 - size/3)) > 0.001 * size) throw TestFailedException(answer);
+  OlaCounters c = ob.statistics().snapshot();
+  if(verbose) c.print(cout);
+  if(c.queries != 1) throw TestFailedException(c.queries);
+  if((c.dataReads == 0) || (c.dataReads > (uint64) (4 * N * b))) throw TestFailedException(c.dataReads);
+  if(c.dataPagesTouched == 0) throw TestFailedException(c.dataPagesTouched);
+  uint64 perlevel = 0;
+  for(int l = 0; l < OlaCounters::MaxLevels; ++l) perlevel += c.readsPerLevel[l];
+  if(perlevel != c.dataReads + c.bufferReads) throw TestFailedException(perlevel);
+  if(c.interpolations < c.dataReads) throw TestFailedException(c.interpolations);
+  ob.updateBuffer(*buffer, size/2, 1.0f);
+  c = ob.statistics().snapshot();
+  if((c.updates != 1) || (c.bufferWrites == 0) || (c.updateDeltas == 0)) throw TestFailedException(c.updates);
+  ob.statistics().reset();
+  c = ob.statistics().snapshot();
+  if(c.queries + c.dataReads + c.bufferReads + c.updates != 0) throw TestFailedException(c.queries);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkEngines(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing engines b = " << b << " N = " << N << " size = " << size << endl;
+  vector<counted_ptr<RangeQueryEngine<float> > > engines;
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new SimdScanEngine<float>()));
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new OlaEngine<float>(b,N)));
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new FenwickEngine<float>()));
+  engines.push_back(counted_ptr<RangeQueryEngine<float> >(new PrefixSumEngine<float>()));
+  for(uint e = 0; e < engines.size(); ++e) {
+    vector<float> data(size);
+    for(int64 k = 0; k < size; ++k) data[k] = (k % 7) - 3.0f;
+    engines[e]->build(data);
+    for(int round = 0; round < 2; ++round) {
+      for(int64 begin = 0; begin < size; begin += 3) {
+        for(int64 end = begin; end <= size; end += 5) {
+          RangedCubicPolynomial sums(1,0,0,0,begin,end), moments(0.5,1,0,0,begin,end);
+          float expectedsums = 0.0f, expectedmoments = 0.0f;
+          for(int64 k = begin; k < end; ++k) {
+            expectedsums += data[k];
+            expectedmoments += (0.5f + k) * data[k];
+          }
+          if(abs(engines[e]->query(sums) - expectedsums) > 0.001f) {
+            cout << engines[e]->name() << " failed on range " << begin << " " << end << endl;
+            throw TestFailedException(engines[e]->query(sums) - expectedsums);
+          }
+          if(abs(engines[e]->query(moments) - expectedmoments) > 0.01f) {
+            cout << engines[e]->name() << " failed on range " << begin << " " << end << endl;
+            throw TestFailedException(engines[e]->query(moments) - expectedmoments);
+          }
+        }
+      }
+      // same again after a few updates
+      for(int64 k = 0; k < size; k += 11) engines[e]->update(k, 2.0f);
+    }
+  }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkQueryCache(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing query cache b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  for(int64 k = 0; k < size; ++k) data[k] = (k % 5) - 2.0f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  OlaQueryCache< float > cache(ob, 3);
+  RangedCubicPolynomial left(1,0,0,0,0,size/4), right(0,1,0,0,3*size/4,size), middle(1,0,0,0,size/3,size/2);
+  float l = cache.query(left, data, *buffer);
+  float r = cache.query(right, data, *buffer);
+  if((cache.query(left, data, *buffer) != l) || (cache.query(right, data, *buffer) != r)) throw TestFailedException(l);
+  if((cache.hits() != 2) || (cache.misses() != 2)) throw TestFailedException(cache.hits());
+  // an update on the right leaves the left query cached
+  const int64 pos = size - 2;
+  pair<int64,int64> dependency = ob.dataDependency(left.mStart, left.mEnd, size);
+  if((pos >= dependency.first) && (pos < dependency.second)) throw TestFailedException(pos);
+  data[pos] += 3.0f;
+  cache.updateBuffer(*buffer, pos, 3.0f);
+  if(cache.invalidations() != 1) throw TestFailedException(cache.invalidations());
+  if(abs(cache.query(left, data, *buffer) - ob.query(left, data, *buffer)) > 0.001) throw TestFailedException(l);
+  if(cache.hits() != 3) throw TestFailedException(cache.hits());
+  float newr = cache.query(right, data, *buffer);
+  if(abs(newr - (r + 3.0f * pos)) > 0.01f) throw TestFailedException(newr);
+  if(cache.misses() != 3) throw TestFailedException(cache.misses());
+  // a third and fourth entry evict the least recently used one (left)
+  cache.query(middle, data, *buffer);
+  RangedCubicPolynomial other(2,0,0,0,size/3,size/2);
+  cache.query(other, data, *buffer);
+  if((cache.size() != 3) || (cache.evictions() != 1)) throw TestFailedException(cache.size());
+  cache.query(right, data, *buffer);
+  if(cache.hits() != 4) throw TestFailedException(cache.hits());
+  cache.query(left, data, *buffer);
+  if(cache.misses() != 6) throw TestFailedException(cache.misses());
+  if(verbose) cache.printStatistics(cout);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+struct ProgressiveRecorder {
+  bool operator()(float estimate, double errorbound, int level) {
+    estimates.push_back(estimate); bounds.push_back(errorbound); levels.push_back(level);
+    return true;
+  }
+  vector<float> estimates; vector<double> bounds; vector<int> levels;
+};
+
+void checkProgressiveQueries(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing progressive queries b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  double maxabs = 0.0;
+  for(int64 k = 0; k < size; ++k) {
+    data[k] = sin(k * 0.01) + ((k * 7919) % 13) / 13.0f;
+    if(abs(data[k]) > maxabs) maxabs = abs(data[k]);
+  }
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  vector<double> bounds = ob.levelBounds(*buffer, maxabs, size);
+  for(int64 begin = 1; begin < size; begin += size / 7) {
+    for(int64 end = begin; end <= size; end += size / 5) {
+      RangedCubicPolynomial rcp(1,0.01,0,0,begin,end);
+      float exact = ob.query(rcp, data, *buffer);
+      ProgressiveRecorder recorder;
+      float answer = progressiveQuery(ob, rcp, data, *buffer, bounds, recorder);
+      if(abs(answer - exact) > 0.001 * (1 + abs(exact))) throw TestFailedException(answer - exact);
+      if(recorder.levels.back() != 0 || recorder.bounds.back() != 0) throw TestFailedException(recorder.levels.back());
+      if((int) recorder.levels.size() != ob.correctionLevels(size) + 1) throw TestFailedException(recorder.levels.size());
+      for(uint k = 0; k < recorder.estimates.size(); ++k) {
+        if(verbose) cout << " level " << recorder.levels[k] << " estimate = " << recorder.estimates[k] 
+          << " +- " << recorder.bounds[k] << " exact = " << exact << endl;
+        if(abs(recorder.estimates[k] - exact) > recorder.bounds[k] + 0.001 * (1 + abs(exact)))
+          throw TestFailedException(recorder.estimates[k] - exact);
+        if((k > 0) && (recorder.bounds[k] > recorder.bounds[k-1])) throw TestFailedException(recorder.bounds[k]);
+      }
+      ProgressiveQuery< float, vector<float> > pq(ob, rcp, data, *buffer, bounds);
+      if(abs(pq.refineUntil(0.0) - exact) > 0.001 * (1 + abs(exact))) throw TestFailedException(pq.estimate());
+    }
+  }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkMinMaxPyramid(int b, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing min/max pyramid b = " << b << " size = " << size << endl;
+  MinMaxPyramid< float > mmp(b);
+  vector<float> data(size);
+  srand(8765);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) (rand() % 50);
+  counted_ptr<vector<MinMaxCell<float> > > pyramid = mmp.computePyramid(data);
+  if((int64) pyramid->size() != mmp.pyramidSize(size)) throw TestFailedException(pyramid->size());
+  for(int round = 0; round < 2; ++round) {
+    for(int64 begin = 0; begin < size; ++begin) {
+      for(int64 end = begin + 1; end <= size; ++end) {
+        MinMaxCell<float> answer = mmp.query(begin, end, data, *pyramid);
+        int64 argmin = begin, argmax = begin;
+        for(int64 k = begin; k < end; ++k) {
+          if(data[k] < data[argmin]) argmin = k;
+          if(data[k] > data[argmax]) argmax = k;
+        }
+        if((answer.argmin != argmin) || (answer.argmax != argmax) || (answer.min != data[argmin])
+            || (answer.max != data[argmax])) {
+          cout << " range " << begin << " " << end << " argmax " << answer.argmax << " vs " << argmax << endl;
+          throw TestFailedException(answer.max);
+        }
+      }
+    }
+    for(int64 k = 0; k < size; k += 3) {
+      data[k] = (float) (rand() % 70) - 10;
+      mmp.update(k, data, *pyramid);
+    }
+  }
+  if(!mmp.query(3, 3, data, *pyramid).isEmpty()) throw TestFailedException(3);
+  // the pyramid in a file, read back after it was closed
+  stringstream name;
+  name << "/tmp/olapyramid" << getpid();
+  const vector<string> files(1, name.str());
+  unlink(files[0].c_str());
+  const uint64 extent = 512;// 512 cells of 24 bytes are whole pages
+  {
+    StripedExternalArray< MinMaxCell<float> > stored(mmp.pyramidSize(size), files, extent);
+    mmp.computePyramid(data, stored);
+  }
+  StripedExternalArray< MinMaxCell<float> > stored(mmp.pyramidSize(size), files, extent);
+  for(int64 begin = 0; begin < size; begin += 3) {
+    for(int64 end = begin; end <= size; end += 5) {
+      MinMaxCell<float> answer = mmp.query(begin, end, data, stored), expected = mmp.query(begin, end, data, *pyramid);
+      if((answer.argmin != expected.argmin) || (answer.argmax != expected.argmax) || (answer.min != expected.min)
+          || (answer.max != expected.max))
+        throw TestFailedException(begin);
+    }
+  }
+  unlink(files[0].c_str());
+  // summaries on the data padded for the Ola buffer
+  OlaBuffer< float > ob(b,1);
+  data.resize(ob.computeRecommendedPaddedLength(size), 0.0f);
+  pyramid = mmp.computePyramid(data);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  RangeSummary<float> summary = summarize(1, size - 1, ob, mmp, data, *buffer, *pyramid);
+  float sum = 0;
+  for(int64 k = 1; k < size - 1; ++k) sum += data[k];
+  if((fabs(summary.sum - sum) > 0.001 * fabs(sum) + 0.01)
+      || (summary.extrema.argmax != mmp.query(1, size - 1, data, *pyramid).argmax))
+    throw TestFailedException(summary.sum);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkPiecewiseQueries(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing piecewise queries b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float, OlaStatistics > ob(b,N);
+  vector<float> data(size);
+  for(int64 k = 0; k < size; ++k) data[k] = (k % 7) - 3.0f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  const int q = size / 8;
+  // a trapezoid, a gap, a (quadratic if N > 1) bump, and two equal pieces in a row
+  PiecewisePolynomial f(q);
+  f.append(CubicPolynomial(-q, 1, 0, 0), 2 * q);
+  f.append(CubicPolynomial(q, 0, 0, 0), 3 * q);
+  f.append(CubicPolynomial(4 * q, -1, 0, 0), 4 * q);
+  f.append(CubicPolynomial(0, 0, 0, 0), 5 * q);
+  if(N > 1) f.append(CubicPolynomial(0, 12.0f / q, -2.0f / (q * q), 0), 6 * q);
+  f.append(CubicPolynomial(2, 0, 0, 0), 6 * q + 3);
+  f.append(CubicPolynomial(2, 0, 0, 0), size);
+  if(f.discontinuities().size() != f.breakpoints().size() - 1) throw TestFailedException(f.discontinuities().size());
+  double expected = 0.0, scale = 0.0;
+  for(int64 x = 0; x < size; ++x) { expected += f(x) * data[x]; scale += fabs(f(x) * data[x]); }
+  ob.statistics().reset();
+  const float answer = ob.query(f, data, *buffer);
+  const OlaCounters onepass = ob.statistics().snapshot();
+  if(fabs(answer - expected) > 0.0001 * scale + 0.01) throw TestFailedException(answer - expected);
+  // the same, one query per piece
+  ob.statistics().reset();
+  float separate = 0.0f;
+  for(int k = 0; k < f.numberOfPieces(); ++k) {
+    RangedCubicPolynomial piece(f.piece(k), f.breakpoints()[k], f.breakpoints()[k + 1]);
+    separate += ob.query(piece, data, *buffer);
+  }
+  const OlaCounters perpiece = ob.statistics().snapshot();
+  if(fabs(answer - separate) > 0.0001 * scale + 0.01) throw TestFailedException(answer - separate);
+  if(onepass.dataReads + onepass.bufferReads >= perpiece.dataReads + perpiece.bufferReads)
+    throw TestFailedException(onepass.dataReads + onepass.bufferReads);
+  if(verbose) cout << " one pass: " << onepass.dataReads + onepass.bufferReads << " reads, per piece: "
+    << perpiece.dataReads + perpiece.bufferReads << " reads" << endl;
+  // degenerate cases: empty and single-piece functions
+  PiecewisePolynomial empty(q);
+  if(ob.query(empty, data, *buffer) != 0.0f) throw TestFailedException(1);
+  PiecewisePolynomial one(0);
+  one.append(CubicPolynomial(1, 0, 0, 0), q);
+  RangedCubicPolynomial same(1, 0, 0, 0, 0, q);
+  if(fabs(ob.query(one, data, *buffer) - ob.query(same, data, *buffer)) > 0.001) throw TestFailedException(2);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkSlidingMoments(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing sliding moments b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  srand(4321);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) (rand() % 100) / 10.0f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  const int moments = 2 * N - 1 < 3 ? 2 * N : 3;
+  SlidingMoments sm(moments);
+  const int64 windowlengths[] = {1, 7, 64, size / 3, -1}, strides[] = {1, 3, 64, 200, -1};
+  for(int w = 0; windowlengths[w] > 0; ++w) {
+    for(int st = 0; strides[st] > 0; ++st) {
+      const int64 W = windowlengths[w], s = strides[st];
+      vector<WindowMoments> sequential(sm.windows(size, W, s)), queried(sm.windows(size, W, s));
+      sm.compute(data, W, s, sequential);
+      sm.computeWithBuffer(data, ob, *buffer, W, s, queried);
+      for(int64 j = 0; j < (int64) sequential.size(); ++j) {
+        double expected[WindowMoments::MaxMoments] = {0,0,0,0};
+        for(int64 t = 0; t < W; ++t)
+          for(int k = 0; k < moments; ++k) expected[k] += pow((double) t, k) * data[j * s + t];
+        for(int k = 0; k < moments; ++k) {
+          const double tolerance = 1e-5 * expected[k] + 0.001;
+          if(fabs(sequential[j].moment[k] - expected[k]) > tolerance) {
+            cout << " W = " << W << " s = " << s << " j = " << j << " k = " << k << endl;
+            throw TestFailedException(sequential[j].moment[k] - expected[k]);
+          }
+          if(fabs(queried[j].moment[k] - expected[k]) > 100 * tolerance) {
+            cout << " W = " << W << " s = " << s << " j = " << j << " k = " << k << " " << expected[k] << endl;
+            throw TestFailedException(queried[j].moment[k] - expected[k]);
+          }
+        }
+      }
+    }
+  }
+  // short strides are done sequentially, long windows and strides from the buffer
+  if(sm.useBuffer(ob, size, size / 3, 1)) throw TestFailedException(1);
+  if(!sm.useBuffer(ob, size, size / 3, size / 3)) throw TestFailedException(2);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkPolynomialFit(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing polynomial fits b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float, OlaStatistics > ob(b,N);
+  typedef PolynomialFitter< float, vector<float>, OlaStatistics > Fitter;
+  // index moments against brute force
+  double moments[7];
+  Fitter::indexMoments(11, 6, moments);
+  for(int k = 0; k <= 6; ++k) {
+    double expected = 0.0;
+    for(int x = 0; x < 11; ++x) expected += pow((x - 5) / 5.0, k);
+    if(fabs(moments[k] - expected) > 1e-9 * (1 + expected)) throw TestFailedException(moments[k] - expected);
+  }
+  // data that is exactly a polynomial of degree 2N - 1 is recovered
+  const int degree = 2 * N - 1 < PolynomialFit::MaxDegree ? 2 * N - 1 : PolynomialFit::MaxDegree;
+  vector<float> data(size);
+  const double center = size / 2.0, half = size / 4.0;
+  for(int64 x = 0; x < size; ++x) {
+    const double u = (x - center) / half;
+    data[x] = (float) (1.0 - 0.5 * u + (degree > 1 ? 0.25 * u * u - 0.125 * u * u * u : 0.0));
+  }
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  Fitter fitter(ob, data, *buffer);
+  const int64 ranges[][2] = {{0, size}, {size / 4, 3 * size / 4}, {3, 3 + 8 * N}, {size / 3, size - 2}};
+  for(int r = 0; r < 4; ++r) {
+    ob.statistics().reset();
+    PolynomialFit p = fitter.fit(ranges[r][0], ranges[r][1], degree);
+    if(ob.statistics().snapshot().queries != 1) throw TestFailedException(ob.statistics().snapshot().queries);
+    for(int64 x = ranges[r][0]; x < ranges[r][1]; x += 1 + size / 97)
+      if(fabs(p(x) - data[x]) > 0.01) {
+        cout << " range " << ranges[r][0] << " " << ranges[r][1] << " x = " << x << endl;
+        throw TestFailedException(p(x) - data[x]);
+      }
+  }
+  // on noisy data, a fit of lower degree matches the normal equations solved by brute force
+  srand(2468);
+  for(int64 x = 0; x < size; ++x) data[x] += (rand() % 100) / 100.0f;
+  *buffer = *ob.computeBuffer(data);// the fitter keeps a reference to the buffer
+  const int64 start = size / 5, end = size / 5 + size / 3;
+  PolynomialFit line = fitter.fit(start, end, 1);
+  double s0 = 0, s1 = 0, s2 = 0, d0 = 0, d1 = 0;
+  for(int64 x = start; x < end; ++x) {
+    const double u = (x - line.center) / line.halfwidth;
+    s0 += 1; s1 += u; s2 += u * u; d0 += data[x]; d1 += u * data[x];
+  }
+  const double slope = (s0 * d1 - s1 * d0) / (s0 * s2 - s1 * s1), intercept = (d0 - slope * s1) / s0;
+  if((fabs(line.coefficient[0] - intercept) > 0.001) || (fabs(line.coefficient[1] - slope) > 0.001))
+    throw TestFailedException(line.coefficient[1] - slope);
+  bool thrown = false;
+  try { fitter.fit(0, 2, 2); } catch(Fitter::InvalidFitException & e) { thrown = true; }
+  if(!thrown) throw TestFailedException(2);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkInPlaceBuffer(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing in-place buffers b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  srand(1357);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) (rand() % 100) / 10.0f;
+  counted_ptr<vector<float> > reference = ob.computeBuffer(data);
+  if((int64) reference->size() != ob.bufferSize(size)) throw TestFailedException(reference->size());
+  // a region of a bigger block of memory, with guards on both sides, holding garbage
+  vector<float> memory(ob.bufferSize(size) + 2, 12345.0f);
+  ArraySpan<float> buffer = ArraySpan<float>(& memory[0], memory.size()).subspan(1, ob.bufferSize(size));
+  ob.computeBuffer(data, buffer);
+  if((memory.front() != 12345.0f) || (memory.back() != 12345.0f)) throw TestFailedException(memory.back());
+  for(int64 k = 0; k < (int64) buffer.size(); ++k)
+    if(fabs(buffer[k] - (*reference)[k]) > 0.0001 * (1 + fabs((*reference)[k]))) throw TestFailedException(k);
+  // the buffer is usable as usual
+  vector<float> copy(buffer.data(), buffer.data() + buffer.size());
+  RangedCubicPolynomial rcp(1,0,0,0,size / 3, size - 1);
+  float expected = 0.0f;
+  for(int64 k = size / 3; k < size - 1; ++k) expected += data[k];
+  if(fabs(ob.query(rcp, data, copy) - expected) > 0.0001 * expected) throw TestFailedException(expected);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkCoefficientTables(int b, int N, bool verbose = false) {
+  if(verbose) cout << " Testing coefficient tables b = " << b << " N = " << N << endl;
+  DubucCoefficients dc(b,N);
+  const int cached = DubucCoefficients::cachedTables();
+  OlaBuffer< float > ob1(b,N), ob2(b,N);
+  DubucCoefficients other(b,N);
+  if(DubucCoefficients::cachedTables() != cached) throw TestFailedException(cached);
+  // the interpolation reproduces polynomials of degree 2N-1, in the middle and on the left
+  for(int r = 0; r < N * b; ++r) {
+    for(int degree = 0; degree < 2 * N; ++degree) {
+      const double x = r / (double) b;
+      double left = 0.0, middle = 0.0;
+      for(int m = 0; m < 2 * N; ++m) {
+        left += dc.leftCoefficients(m, r) * pow((double) m, degree);
+        if(r < b) middle += dc.coefficients(m - N + 1, r) * pow((double) (m - N + 1), degree);
+      }
+      const double tolerance = 1e-9 * pow(2.0 * N, degree);
+      if(fabs(left - pow(x, degree)) > tolerance) throw TestFailedException(left - pow(x, degree));
+      if((r < b) && (fabs(middle - pow(x, degree)) > tolerance)) throw TestFailedException(middle);
+      if(dc.leftRow(r)[degree] != dc.leftCoefficients(degree, r)) throw TestFailedException(r);
+      if((r < b) && (dc.coefficientRow(r)[degree] != dc.coefficients(degree - N + 1, r))) throw TestFailedException(r);
+      if(dc.rightCoefficients(degree, r) != dc.leftCoefficients(2 * N - 1 - degree, r)) throw TestFailedException(r);
+    }
+  }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkMultiSeries(int b, int N, int64 size, int K, bool verbose = false) {
+  if(verbose) cout << " Testing multi-series b = " << b << " N = " << N << " size = " << size << " K = " << K << endl;
+  OlaBuffer< float > ob(b,N);
+  MultiSeriesOlaBuffer< float > msb(b,N,K);
+  vector<float> data(size * K);
+  vector<vector<float> > series(K, vector<float>(size));
+  srand(97531);
+  for(int64 x = 0; x < size; ++x)
+    for(int s = 0; s < K; ++s) series[s][x] = data[x * K + s] = (float) (rand() % 100) / 10.0f - s;
+  counted_ptr<vector<float> > buffer = msb.computeBuffer(data);
+  if((int64) buffer->size() != msb.bufferSize(size)) throw TestFailedException(buffer->size());
+  for(int s = 0; s < K; ++s) {
+    counted_ptr<vector<float> > single = ob.computeBuffer(series[s]);
+    for(int64 k = 0; k < (int64) single->size(); ++k)
+      if(fabs((*buffer)[k * K + s] - (*single)[k]) > 0.0001 * (1 + fabs((*single)[k]))) throw TestFailedException(k);
+  }
+  // updates of all series, and of one
+  vector<float> changes(K);
+  for(int s = 0; s < K; ++s) changes[s] = s + 1.0f;
+  const int64 positions[] = {0, 1, size / 2 + 1, size - 2, size - 1};
+  for(int p = 0; p < 5; ++p) {
+    for(int s = 0; s < K; ++s) { data[positions[p] * K + s] += changes[s]; series[s][positions[p]] += changes[s]; }
+    msb.updateBuffer(*buffer, positions[p], & changes[0]);
+  }
+  data[(size / 3) * K + K - 1] += 5.0f;
+  series[K - 1][size / 3] += 5.0f;
+  msb.updateBuffer(*buffer, size / 3, K - 1, 5.0f);
+  // queries agree with the scalar ones
+  vector<float> answers(K);
+  const int64 ranges[][2] = {{0, size}, {1, size - 1}, {size / 3, size / 3 + 1}, {size / 5, 4 * size / 5}};
+  for(int r = 0; r < 4; ++r) {
+    RangedCubicPolynomial rcp(1, 0.5f, 0, 0, ranges[r][0], ranges[r][1]);
+    msb.query(rcp, data, *buffer, & answers[0]);
+    for(int s = 0; s < K; ++s) {
+      counted_ptr<vector<float> > single = ob.computeBuffer(series[s]);
+      const float expected = ob.query(rcp, series[s], *single);
+      if(fabs(answers[s] - expected) > 0.0001 * (1 + fabs(expected))) throw TestFailedException(answers[s] - expected);
+    }
+  }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkBufferArena(int b, int N, int count, bool verbose = false) {
+  if(verbose) cout << " Testing buffer arena b = " << b << " N = " << N << " count = " << count << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<vector<float> > series(count);
+  srand(24680);
+  for(int i = 0; i < count; ++i) {
+    series[i].resize(ob.computeRecommendedPaddedLength(4 * N * b + rand() % 1000));
+    for(uint64 k = 0; k < series[i].size(); ++k) series[i][k] = (float) (rand() % 100) / 10.0f;
+  }
+  BufferArena< float > arena(ob);
+  arena.build(series);
+  if(arena.size() != count) throw TestFailedException(arena.size());
+  if(arena.used() != arena.capacity()) throw TestFailedException(arena.capacity());
+  // built twice: the slab is reused
+  const int64 capacity = arena.capacity();
+  arena.build(series);
+  if(arena.capacity() != capacity) throw TestFailedException(arena.capacity());
+  for(int i = 0; i < count; ++i) {
+    series[i][series[i].size() / 2] += 1.0f;
+    if(i % 3 == 0) arena.rebuild(i, series[i]);
+  }
+  for(int i = 0; i < count; ++i) {
+    if(i % 3 != 0) arena.rebuild(i, series[i]);
+    counted_ptr<vector<float> > reference = ob.computeBuffer(series[i]);
+    ArraySpan<float> buffer = arena[i];
+    if(buffer.size() != reference->size()) throw TestFailedException(i);
+    for(uint64 k = 0; k < buffer.size(); ++k)
+      if(fabs(buffer[k] - (*reference)[k]) > 0.0001 * (1 + fabs((*reference)[k]))) throw TestFailedException(k);
+    const int64 size = series[i].size();
+    RangedCubicPolynomial rcp(1,0,0,0,size / 4, size - 1);
+    float expected = 0.0f;
+    for(int64 k = size / 4; k < size - 1; ++k) expected += series[i][k];
+    if(fabs(ob.query(rcp, series[i], buffer) - expected) > 0.0001 * expected) throw TestFailedException(expected);
+  }
+  arena.clear();
+  if((arena.size() != 0) || (arena.used() != 0) || (arena.capacity() != capacity)) throw TestFailedException(arena.size());
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+// one at position mPosition, zero elsewhere
+class Delta : public unary_function<uint64,float> {
+  public:
+    Delta(int64 Position = 0) : mPosition(Position) {}
+    float operator()(const uint64 x) const { return (int64) x == mPosition ? 1.0f : 0.0f; }
+    int64 mPosition;
+};
+
+/*
+ * Arrays beyond 2^32 values: the data is a delta at some position, stored
+ * virtually, and its buffer is that of an all-zero array updated at that
+ * position, so that we never scan the whole array.
+ */
+void checkLargeIndexes(int b, int N, bool verbose = false) {
+  OlaBuffer< float > ob(b,N);
+  const int64 size = ob.computeRecommendedPaddedLength(((int64) 1 << 33) + 12345);
+  if(verbose) cout << " Testing large indexes b = " << b << " N = " << N << " size = " << size << endl;
+  if((size < ((int64) 1 << 33) + 12345) || (ob.computeRecommendedPaddedLength(size) != size))
+    throw TestFailedException(size);
+  const int64 positions[] = {((int64) 1 << 32) + 77, size - 2, ((int64) 1 << 31) - 1};
+  for(int p = 0; p < 3; ++p) {
+    const int64 position = positions[p];
+    const Delta delta(position);
+    VirtualArray< float, Delta > data(size, delta);
+    vector<float> buffer(ob.bufferSize(size), 0.0f);
+    ob.updateBuffer(buffer, position, 1.0f);
+    const int64 ranges[][2] = {{0, size}, {position, position + 1}, {position + 1, size},
+      {position - ((int64) 1 << 32), position}, {position - 1000, position + 1}, {((int64) 1 << 32), size - 1}};
+    for(int r = 0; r < 6; ++r) {
+      const int64 start = ranges[r][0] < 0 ? 0 : ranges[r][0], end = ranges[r][1];
+      const float expected = (start <= position) && (position < end) ? 1.0f : 0.0f;
+      RangedCubicPolynomial sum(1,0,0,0,start,end);
+      if(fabs(ob.query(sum, data, buffer) - expected) > 0.001) throw TestFailedException(r);
+      if(end - start > 100000) continue;// float moments of long ranges are not that accurate
+      ShiftedMonomial first(1,start,end);
+      if(fabs(ob.query(first, data, buffer) - expected * (position - start)) > 0.001 * (position - start) + 0.001)
+        throw TestFailedException(r);
+    }
+    // a piecewise query with breakpoints beyond 2^32
+    PiecewisePolynomial pp(position - 10);
+    pp.append(CubicPolynomial(2,0,0,0), position);
+    pp.append(CubicPolynomial(3,0,0,0), position + 1);
+    if(fabs(ob.query(pp, data, buffer) - 3.0f) > 0.001) throw TestFailedException(position);
+  }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkStripedArray(int files, uint64 extent, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing striped array files = " << files << " extent = " << extent << " size = " << size << endl;
+  vector<string> names;
+  for(int f = 0; f < files; ++f) {
+    ostringstream name;
+    name << "/tmp/olastripe-" << getpid() << "-" << f;
+    names.push_back(name.str());
+    unlink(names.back().c_str());
+  }
+  OlaBuffer< float > ob(4,2);
+  vector<float> data(size);
+  {
+    StripedExternalArray<float> array(size, names, extent);
+    if((array.size() != (uint64) size) || (array.files() != (uint64) files)) throw TestFailedException(array.size());
+    for(int64 k = 0; k < size; ++k) if(array[k] != 0.0f) throw TestFailedException(k);
+    srand(8642);
+    for(int64 k = 0; k < size; ++k) array[k] = data[k] = (float) (rand() % 100) / 10.0f;
+    // the pieces of the files covering a range cover it exactly
+    for(int t = 0; t < 200; ++t) {
+      const uint64 a = rand() % (size + 1), b = rand() % (size + 1);
+      const uint64 begin = a < b ? a : b, end = a < b ? b : a;
+      uint64 total = 0;
+      for(uint64 f = 0; f < array.files(); ++f) {
+        pair<uint64,uint64> local = array.localRange(f, begin, end);
+        if(local.second > local.first) total += local.second - local.first;
+      }
+      if(total != end - begin) throw TestFailedException(t);
+    }
+    for(uint64 f = 0; f < array.files(); ++f) {
+      pair<uint64,uint64> local = array.localRange(f, 0, size);
+      if((local.first != 0) || (local.second > (uint64) (size / (extent * files) + 1) * extent)) throw TestFailedException(f);
+    }
+  }
+  // reopened, with the data we wrote
+  StripedExternalArray<float> array(size, names, extent);
+  array.willNeed(size / 3, size);
+  array.load(0, size);
+  for(int64 k = 0; k < size; ++k) if(array[k] != data[k]) throw TestFailedException(k);
+  counted_ptr<vector<float> > reference = ob.computeBuffer(data);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(array);
+  for(uint64 k = 0; k < buffer->size(); ++k) if((*buffer)[k] != (*reference)[k]) throw TestFailedException(k);
+  RangedCubicPolynomial rcp(1,0,0,0,size / 5, size - 3);
+  if(ob.query(rcp, array, *buffer) != ob.query(rcp, data, *reference)) throw TestFailedException(size);
+  for(int f = 0; f < files; ++f) unlink(names[f].c_str());
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkStreamBuilder(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing stream builder b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size, 0.0f);
+  srand(11235);
+  for(int64 k = 0; k < size - size / 7; ++k) data[k] = (float) (rand() % 100) / 10.0f - 3.0f;
+  counted_ptr<vector<float> > reference = ob.computeBuffer(data);
+  // one value at a time
+  vector<float> stored(size, -1.0f), buffer(ob.bufferSize(size), 123.0f);
+  OlaStreamBuilder< float, vector<float>, vector<float> > builder(ob, size, stored, buffer);
+  for(int64 k = 0; k < size; ++k) {
+    if(builder.finished()) throw TestFailedException(k);
+    builder.push(data[k]);
+  }
+  if(!builder.finished() || (stored != data)) throw TestFailedException(size);
+  for(uint64 k = 0; k < buffer.size(); ++k)
+    if(fabs(buffer[k] - (*reference)[k]) > 0.0001 * (1 + fabs((*reference)[k]))) throw TestFailedException(k);
+  // from a binary stream that stops early, padded with zeroes
+  const string bytes((const char *) & data[0], (size - size / 7) * sizeof(float));
+  istringstream in(bytes);
+  vector<float> stored2(size, -1.0f), buffer2(ob.bufferSize(size));
+  OlaStreamBuilder< float, vector<float>, vector<float> > builder2(ob, size, stored2, buffer2);
+  if(builder2.ingest(in) != size - size / 7) throw TestFailedException(builder2.position());
+  if(builder2.finished()) throw TestFailedException(size);
+  builder2.finish();
+  if(!builder2.finished() || (stored2 != data)) throw TestFailedException(size);
+  for(uint64 k = 0; k < buffer2.size(); ++k)
+    if(fabs(buffer2[k] - (*reference)[k]) > 0.0001 * (1 + fabs((*reference)[k]))) throw TestFailedException(k);
+  // a stream that ends in the middle of a value
+  istringstream truncated(bytes.substr(0, 5 * sizeof(float) + 2));
+  vector<float> stored3(size, -1.0f), buffer3(ob.bufferSize(size));
+  OlaStreamBuilder< float, vector<float>, vector<float> > builder3(ob, size, stored3, buffer3);
+  bool thrown = false;
+  try { builder3.ingest(truncated); }
+  catch(OlaStreamBuilder< float, vector<float>, vector<float> >::TruncatedValueException&) { thrown = true; }
+  if(!thrown || (builder3.position() != 5)) throw TestFailedException(builder3.position());
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkCheckpoints(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing checkpoints b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  srand(3141);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) (rand() % 100) / 10.0f;
+  vector<float> buffer = *ob.computeBuffer(data);
+  DirtyPageArray< float > trackeddata(data), trackedbuffer(buffer);
+  ostringstream prefix;
+  prefix << "/tmp/olackpt-" << getpid();
+  IncrementalCheckpoint cp(prefix.str());
+  cp.track(trackeddata);
+  cp.track(trackedbuffer);
+  const uint64 total = trackeddata.pages() + trackedbuffer.pages();
+  // the first checkpoint of each slot is full, then they are incremental
+  for(int epoch = 1; epoch <= 5; ++epoch) {
+    for(int u = 0; u < 3; ++u) {
+      const int64 pos = rand() % size;
+      trackeddata[pos] += 1.0f;
+      ob.updateBuffer(trackedbuffer, pos, 1.0f);
+    }
+    if(trackeddata.dirtyPages().size() > 3) throw TestFailedException(trackeddata.dirtyPages().size());
+    const uint64 written = cp.checkpoint();
+    if((epoch <= 2) && (written != total)) throw TestFailedException(written);
+    if((epoch > 2) && (written * 4 > total)) throw TestFailedException(written);
+    if((cp.epoch() != (uint64) epoch) || (trackeddata.dirtyPages().size() != 0)) throw TestFailedException(epoch);
+  }
+  const vector<float> saveddata(data), savedbuffer(buffer);
+  // changes after the checkpoint, and garbage in the slot it did not use
+  trackeddata[size / 2] += 5.0f;
+  ob.updateBuffer(trackedbuffer, size / 2, 5.0f);
+  {
+    fstream other((prefix.str() + ".slot0").c_str(), ios::in | ios::out | ios::binary);
+    other.write("garbage", 7);
+  }
+  // restarting
+  vector<float> data2(size, 0.0f), buffer2(buffer.size(), 0.0f);
+  DirtyPageArray< float > trackeddata2(data2), trackedbuffer2(buffer2);
+  IncrementalCheckpoint cp2(prefix.str());
+  cp2.track(trackeddata2);
+  cp2.track(trackedbuffer2);
+  if(!cp2.restore() || (cp2.epoch() != 5)) throw TestFailedException(cp2.epoch());
+  if((data2 != saveddata) || (buffer2 != savedbuffer)) throw TestFailedException(size);
+  RangedCubicPolynomial rcp(1,0,0,0,size / 3, size - 2);
+  float expected = 0.0f;
+  for(int64 k = size / 3; k < size - 2; ++k) expected += data2[k];
+  if(fabs(ob.query(rcp, data2, buffer2) - expected) > 0.0001 * expected) throw TestFailedException(expected);
+  // the slot with garbage gets a full checkpoint, then incremental again
+  trackeddata2[1] += 1.0f;
+  ob.updateBuffer(trackedbuffer2, 1, 1.0f);
+  if(cp2.checkpoint() != total) throw TestFailedException(cp2.epoch());
+  trackeddata2[2] += 1.0f;
+  ob.updateBuffer(trackedbuffer2, 2, 1.0f);
+  if(cp2.checkpoint() * 4 > total) throw TestFailedException(cp2.epoch());
+  vector<float> data3(size), buffer3(buffer.size());
+  DirtyPageArray< float > trackeddata3(data3), trackedbuffer3(buffer3);
+  IncrementalCheckpoint cp3(prefix.str());
+  cp3.track(trackeddata3);
+  cp3.track(trackedbuffer3);
+  if(!cp3.restore() || (data3 != data2) || (buffer3 != buffer2)) throw TestFailedException(cp3.epoch());
+  // reads of 1000 bytes: every array takes several, most of them ending mid-page
+  vector<float> data4(size), buffer4(buffer.size());
+  DirtyPageArray< float > trackeddata4(data4), trackedbuffer4(buffer4);
+  IncrementalCheckpoint cp4(prefix.str(), 1000);
+  cp4.track(trackeddata4);
+  cp4.track(trackedbuffer4);
+  if(!cp4.restore() || (data4 != data2) || (buffer4 != buffer2)) throw TestFailedException(cp4.epoch());
+  unlink((prefix.str() + ".slot0").c_str());
+  unlink((prefix.str() + ".slot1").c_str());
+  unlink((prefix.str() + ".manifest").c_str());
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+// counts how many times each job ran
+class CountingBatch : public OlaBatch {
+  public:
+    CountingBatch(int64 count, int64 grain) : OlaBatch(count, grain), mRuns(count, 0) {}
+    virtual ~CountingBatch();
+    virtual void execute(const int64 begin, const int64 end) {
+      for(int64 k = begin; k < end; ++k) __sync_fetch_and_add(& mRuns[k], 1);
+    }
+    vector<int> mRuns;
+};
+
+// out of line, so that -Winline has nothing to say about it
+CountingBatch::~CountingBatch() {}
+
+void checkExecutor(int threads, bool pin, bool verbose = false) {
+  if(verbose) cout << " Testing executor threads = " << threads << endl;
+  OlaExecutor executor(threads, pin);
+  if(executor.threads() != (threads > 0 ? threads : OlaExecutor::cores())) throw TestFailedException(executor.threads());
+  OlaBuffer< float > ob(4,2);
+  const int64 size = 16385;
+  vector<float> data(size);
+  srand(2718);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) (rand() % 100) / 10.0f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  const int count = 5000;
+  vector<RangedCubicPolynomial> queries;
+  for(int q = 0; q < count; ++q) {
+    const int64 a = rand() % (size + 1), b = rand() % (size + 1);
+    queries.push_back(RangedCubicPolynomial(1, 0.5f, 0, 0, a < b ? a : b, a < b ? b : a));
+  }
+  vector<RangedFunction *> functions;
+  for(int q = 0; q < count; ++q) functions.push_back(& queries[q]);
+  // two batches in flight at once
+  vector<float> answers(count, -1.0f), answers2(count / 2, -1.0f);
+  OlaQueryBatch< float, vector<float>, vector<float> > batch(ob, & functions[0], count, data, *buffer, & answers[0], 8);
+  OlaQueryBatch< float, vector<float>, vector<float> > batch2(ob, & functions[0], count / 2, data, *buffer, & answers2[0]);
+  executor.submit(batch);
+  executor.submit(batch2);
+  batch.wait();
+  batch2.wait();
+  if(!batch.done() || !batch2.done()) throw TestFailedException(count);
+  for(int q = 0; q < count; ++q) {
+    const float expected = ob.query(queries[q], data, *buffer);
+    if(answers[q] != expected) throw TestFailedException(q);
+    if((q < count / 2) && (answers2[q] != expected)) throw TestFailedException(q);
+  }
+  // every job runs exactly once, whatever the grain
+  for(int64 grain = 1; grain <= 1024; grain *= 32) {
+    CountingBatch counting(100000, grain);
+    executor.run(counting);
+    for(int64 k = 0; k < counting.size(); ++k) if(counting.mRuns[k] != 1) throw TestFailedException(k);
+  }
+  CountingBatch empty(0, 1);
+  executor.run(empty);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkInterleavedQueries(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing interleaved queries b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size);
+  srand(1618);
+  for(int64 k = 0; k < size; ++k) data[k] = (float) (rand() % 100) / 10.0f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  const int count = 203;
+  vector<RangedCubicPolynomial> queries;
+  for(int q = 0; q < count; ++q) {
+    const int64 a = rand() % (size + 1), c = rand() % (size + 1);
+    queries.push_back(RangedCubicPolynomial(1, 0.25f, 0, 0, a < c ? a : c, a < c ? c : a));
+  }
+  queries[0] = RangedCubicPolynomial(1, 0, 0, 0, 0, size);
+  queries[1] = RangedCubicPolynomial(1, 0, 0, 0, size / 2, size / 2);
+  vector<RangedFunction *> functions;
+  for(int q = 0; q < count; ++q) functions.push_back(& queries[q]);
+  const int groups[] = {1, 3, 8, 64};
+  for(int g = 0; g < 4; ++g) {
+    vector<float> answers(count, -1.0f);
+    ob.interleavedQuery(& functions[0], count, data, *buffer, & answers[0], groups[g]);
+    for(int q = 0; q < count; ++q)
+      if(answers[q] != ob.query(queries[q], data, *buffer)) throw TestFailedException(q);
+  }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkRangeUpdate(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing range updates b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> data(size), expected(size);
+  srand(2718);
+  for(int64 k = 0; k < size; ++k) expected[k] = data[k] = (float) (rand() % 100) / 10.0f;
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(data);
+  vector<float> original(*buffer);
+  PolynomialOverlay< float > dataview(data), bufferview(*buffer);
+  const int count = 9;
+  const int64 starts[count] = {0, 0, size / 3, 1, size / 2, size - 5, size / 4, 7, size / 5};
+  const int64 ends[count] = {size, 3, 2 * size / 3, size - 1, size, size, size / 4 + b + 1, size / 2, size / 5 + 1};
+  for(int u = 0; u < count; ++u) {
+    vector<double> p;
+    p.push_back((u % 3) - 1.5);
+    if(u % 2 == 1) p.push_back(3.0 / size);
+    if(u % 4 == 2) { p.push_back(-1.0 / size); p.push_back(2.0 / ((double) size * size)); }
+    if(u == 3) p.push_back(1.0 / ((double) size * size * size));
+    ob.updateRange(dataview, bufferview, starts[u], ends[u], p);
+    for(int64 x = starts[u]; x < ends[u]; ++x) {
+      double value = 0;
+      for(int j = p.size() - 1; j >= 0; --j) value = value * x + p[j];
+      expected[x] += value;
+    }
+  }
+  // a cubic over its range
+  const RangedCubicPolynomial rcp(0.5f, 0, 0, 1.0f / ((float) size * size * size), size / 7, size - size / 7);
+  ob.updateRange(dataview, bufferview, rcp);
+  for(int64 x = rcp.mStart; x < rcp.mEnd; ++x) expected[x] += rcp(x);
+  // sublinear: one term per level, and few cells written directly
+  if(bufferview.terms() > (uint64) (count + 1) * ob.correctionLevels(size)) throw TestFailedException(size);
+  int64 touched = 0;
+  for(uint64 c = 0; c < buffer->size(); ++c) if((*buffer)[c] != original[c]) ++touched;
+  if(touched > (count + 1) * 8 * (N + 1) * ob.correctionLevels(size)) throw TestFailedException(touched);
+  // the overlays answer queries as the updated data and buffer would
+  counted_ptr<vector<float> > fresh = ob.computeBuffer(expected);
+  for(int q = 0; q < 100; ++q) {
+    const int64 a = rand() % (size + 1), c = rand() % (size + 1);
+    RangedCubicPolynomial f(1, 0.5f / size, 0, 0, a < c ? a : c, a < c ? c : a);
+    const float answer = ob.query(f, dataview, bufferview), truth = ob.query(f, expected, *fresh);
+    if(fabs(answer - truth) > 1e-3 * (size + fabs(truth))) {
+      cout << " query " << f.mStart << " to " << f.mEnd << " answer = " << answer << " truth = " << truth << endl;
+      throw TestFailedException(q);
+    }
+  }
+  dataview.materialize();
+  bufferview.materialize();
+  if(bufferview.terms() != 0) throw TestFailedException(0);
+  for(int64 x = 0; x < size; ++x)
+    if(fabs(data[x] - expected[x]) > 1e-3 * (1 + fabs(expected[x]))) throw TestFailedException(x);
+  for(uint64 c = 0; c < buffer->size(); ++c)
+    if(fabs((*buffer)[c] - (*fresh)[c]) > 1e-3 * (1 + fabs((*fresh)[c]))) {
+      cout << " cell " << c << " updated = " << (*buffer)[c] << " recomputed = " << (*fresh)[c] << endl;
+      throw TestFailedException(c);
+    }
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkBufferAlgebra(int b, int N, int64 size, int threads, bool verbose = false) {
+  if(verbose) cout << " Testing buffer algebra b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> first(size), second(size), combined(size);
+  srand(4669);
+  for(int64 k = 0; k < size; ++k) {
+    first[k] = (float) (rand() % 100) / 10.0f;
+    second[k] = (float) (rand() % 100) / 10.0f;
+    combined[k] = 2.0f * first[k] - 0.5f * second[k];
+  }
+  counted_ptr<vector<float> > firstbuffer = ob.computeBuffer(first), secondbuffer = ob.computeBuffer(second);
+  counted_ptr<vector<float> > expected = ob.computeBuffer(combined);
+  OlaExecutor executor(threads, false);
+  BufferAlgebra< float > algebra(threads > 0 ? & executor : 0, 1000);
+  // 2 first - 0.5 second, on the buffers and on the data
+  vector<float> total(*firstbuffer);
+  ArraySpan<float> span(& total[0], total.size());
+  algebra.add(span, *firstbuffer);
+  algebra.axpy(total, -0.5f, *secondbuffer);
+  vector<float> totaldata(first);
+  deque<float> seconddata(second.begin(), second.end());// not contiguous
+  algebra.scale(totaldata, 2.0f);
+  algebra.subtract(totaldata, seconddata);
+  algebra.axpy(totaldata, 0.5f, second);
+  for(int64 k = 0; k < size; ++k) if(fabs(totaldata[k] - combined[k]) > 1e-4 * (1 + fabs(combined[k])))
+    throw TestFailedException(k);
+  for(uint64 c = 0; c < total.size(); ++c)
+    if(fabs(total[c] - (*expected)[c]) > 1e-4 * (1 + fabs((*expected)[c]))) throw TestFailedException(c);
+  for(int q = 0; q < 50; ++q) {
+    const int64 a = rand() % (size + 1), c = rand() % (size + 1);
+    RangedCubicPolynomial f(1, 0, 0, 0, a < c ? a : c, a < c ? c : a);
+    const float answer = ob.query(f, totaldata, total), truth = ob.query(f, combined, *expected);
+    if(fabs(answer - truth) > 1e-4 * (size + fabs(truth))) throw TestFailedException(q);
+  }
+  // a buffer minus itself
+  algebra.subtract(total, total);
+  for(uint64 c = 0; c < total.size(); ++c) if(total[c] != 0) throw TestFailedException(c);
+  bool thrown = false;
+  vector<float> shorter(total.size() - 1);
+  try { algebra.add(total, shorter); } catch(BufferAlgebra< float >::SizeMismatchException&) { thrown = true; }
+  if(!thrown) throw TestFailedException(shorter.size());
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+// counts its reads
+class CountingArray {
+  public:
+    CountingArray(const vector<float> & data) : mData(data), mReads(0) {}
+    inline float operator[](const uint64 pos) const { ++mReads; return mData[pos]; }
+    inline uint64 size() const { return mData.size(); }
+    int64 reads() const { return mReads; }
+  protected:
+    const vector<float> & mData;
+    mutable int64 mReads;
+};
+
+void checkRebase(int b, int N, int k, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing rebasing b = " << b << " N = " << N << " k = " << k << " size = " << size << endl;
+  int B = 1;
+  for(int j = 0; j < k; ++j) B *= b;
+  OlaBuffer< float > small(b,N), large(B,N);
+  vector<float> data(size);
+  srand(1414);
+  for(int64 x = 0; x < size; ++x) data[x] = (float) (rand() % 100) / 10.0f;
+  counted_ptr<vector<float> > buffer = small.computeBuffer(data);
+  counted_ptr<vector<float> > expected = large.computeBuffer(data);
+  CountingArray counted(data);
+  vector<float> rebased(large.bufferSize(size));
+  large.rebaseBuffer(small, *buffer, counted, rebased);
+  if(N == 1 && counted.reads() != 0) throw TestFailedException(counted.reads());
+  if(counted.reads() > 4 * N * b * (size / B + 1)) throw TestFailedException(counted.reads());
+  for(uint64 c = 0; c < rebased.size(); ++c)
+    if(fabs(rebased[c] - (*expected)[c]) > 1e-3 * (1 + fabs((*expected)[c]))) {
+      cout << " cell " << c << " rebased = " << rebased[c] << " computed = " << (*expected)[c] << endl;
+      throw TestFailedException(c);
+    }
+  for(int q = 0; q < 50; ++q) {
+    const int64 a = rand() % (size + 1), c = rand() % (size + 1);
+    RangedCubicPolynomial f(1, 0, 0, 0, a < c ? a : c, a < c ? c : a);
+    const float answer = large.query(f, data, rebased), truth = large.query(f, data, *expected);
+    if(fabs(answer - truth) > 1e-4 * (size + fabs(truth))) throw TestFailedException(q);
+  }
+  // not a power of b, or the other way around
+  bool thrown = false;
+  try { small.rebaseBuffer(large, rebased, data, *buffer); }
+  catch(OlaBuffer< float >::NotNestedException&) { thrown = true; }
+  if(!thrown) throw TestFailedException(B);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkSparse(int b, int N, int64 size, int spacing, bool verbose = false) {
+  if(verbose) cout << " Testing sparse data b = " << b << " N = " << N << " size = " << size << endl;
+  OlaBuffer< float > ob(b,N);
+  vector<float> dense(size, 0.0f);
+  vector<pair<int64, float> > entries;
+  srand(1732);
+  for(int64 x = rand() % spacing; x < size; x += 1 + rand() % (2 * spacing)) {
+    dense[x] = (float) (1 + rand() % 100) / 10.0f;
+    entries.push_back(pair<int64, float>(x, dense[x]));
+  }
+  entries.push_back(pair<int64, float>(size - 1, dense[size - 1] = 1.5f));
+  SparseArray< float > data(size, entries);
+  SparseBuffer< float > buffer(ob.bufferSize(size));
+  ob.computeSparseBuffer(data.entries(), size, buffer);
+  counted_ptr<vector<float> > expected = ob.computeBuffer(dense);
+  // the memory follows the nonzeros
+  if(buffer.nonzeros() > data.nonzeros() * 2 * N * ob.correctionLevels(size) + 2 * N)
+    throw TestFailedException(buffer.nonzeros());
+  for(uint64 c = 0; c < expected->size(); ++c)
+    if(fabs(buffer[c] - (*expected)[c]) > 1e-4 * (1 + fabs((*expected)[c]))) {
+      cout << " cell " << c << " sparse = " << buffer[c] << " dense = " << (*expected)[c] << endl;
+      throw TestFailedException(c);
+    }
+  for(int u = 0; u < 20; ++u) {
+    const int64 pos = rand() % size;
+    const float change = (float) (rand() % 20) - 10.0f;
+    data.add(pos, change);
+    dense[pos] += change;
+    ob.updateBuffer(buffer, pos, change);
+    ob.updateBuffer(*expected, pos, change);
+  }
+  for(int q = 0; q < 100; ++q) {
+    const int64 a = rand() % (size + 1), c = rand() % (size + 1);
+    RangedCubicPolynomial f(1, 0.25f, 0, 0, a < c ? a : c, a < c ? c : a);
+    const float answer = ob.query(f, data, buffer), truth = ob.query(f, dense, *expected);
+    if(fabs(answer - truth) > 1e-4 * (size + fabs(truth))) throw TestFailedException(q);
+  }
+  // a dense buffer from the sparse list
+  vector<float> densebuffer(ob.bufferSize(size), 0.0f);
+  SparseArray< float > original(size, entries);
+  ob.computeSparseBuffer(original.entries(), size, densebuffer);
+  ob.computeBuffer(original, *expected);
+  for(uint64 c = 0; c < densebuffer.size(); ++c)
+    if(fabs(densebuffer[c] - (*expected)[c]) > 1e-4 * (1 + fabs((*expected)[c]))) throw TestFailedException(c);
+  if(verbose) cout << "    *Test succesful* " << endl; 
+}
+
+void checkCachedArray(int b, int N, int64 size, bool verbose = false) {
+  if(verbose) cout << " Testing cached external arrays b = " << b << " N = " << N << " size = " << size << endl;
+  stringstream name;
+  name << "/tmp/olacached" << getpid();
+  unlink(name.str().c_str());
+  const int blockbytes = 4096, values = blockbytes / sizeof(float);
+  vector<float> expected(size);
+  srand(1123);
+  {
+    // a cache of 8 blocks, much smaller than the array
+    CachedExternalArray<float> data(size, name.str(), 8 * blockbytes, blockbytes);
+    for(int64 x = 0; x < size; ++x) data.set(x, expected[x] = (float) (rand() % 100) / 10.0f);
+    if(data.bytesWritten() == 0) throw TestFailedException(0);
+  }// written back in the destructor
+  CachedExternalArray<float> data(size, name.str(), 8 * blockbytes, blockbytes);
+  const CachedExternalArray<float> & reader = data;// reads only
+  for(int64 x = 0; x < size; ++x) if(reader[x] != expected[x]) throw TestFailedException(x);
+  if(data.cachedBlocks() != 8) throw TestFailedException(data.cachedBlocks());
+  // queries read the same as from memory
+  OlaBuffer< float > ob(b,N);
+  counted_ptr<vector<float> > buffer = ob.computeBuffer(expected);
+  for(int q = 0; q < 100; ++q) {
+    const int64 a = rand() % (size + 1), c = rand() % (size + 1);
+    RangedCubicPolynomial f(1, 0.5f, 0, 0, a < c ? a : c, a < c ? c : a);
+    if(ob.query(f, reader, *buffer) != ob.query(f, expected, *buffer)) throw TestFailedException(q);
+  }
+  // a hot set of two blocks survives a scan
+  const int64 hot1 = 3 * values + 1, hot2 = 5 * values + 2;
+  volatile float sink = 0;
+  for(int round = 0; round < 3; ++round) {
+    for(int64 x = (round + 10) * values; x < (round + 11) * values; x += values / 4) sink += reader[x];
+    sink += reader[hot1]; sink += reader[hot2];
+  }
+  for(int64 x = 0; x < size; ++x) sink += reader[x];// the scan
+  data.flush();
+  if(data.bytesWritten() != 0) throw TestFailedException(data.bytesWritten());// nothing was dirty
+  data.resetStatistics();
+  sink += reader[hot1]; sink += reader[hot2];
+  if((data.hits() != 2) || (data.misses() != 0) || (data.hitRatio() != 1) || (data.bytesRead() != 0))
+    throw TestFailedException(data.misses());
+  sink += reader[size / 2];
+  if((data.misses() != 1) || (data.bytesRead() != (uint64) blockbytes)) throw TestFailedException(data.misses());
+  unlink(name.str().c_str());
+  if(verbose) cout << "    *Test succesful* direct = " << data.direct() << endl; 
+}
+
 int main() {
   bool verbose = false;
   checkUpdate(2,1,5,verbose);
@@ -265,6 +1355,11 @@ int main() {
   checkUpdate(4,1,9);
   checkUpdate(4,2,13);
   cout << "updates b = 4 ok" << endl;
+  checkBoundaries(2,2,65);
+  checkBoundaries(2,3,129);
+  checkBoundaries(3,2,3*3*3*3*3+1);
+  checkBoundaries(4,2,4*4*4*4+1);
+  cout << "boundaries ok " << endl;
   rangeSums(2,1,5,verbose);
   rangeSums(2,1,9,verbose);
   rangeSums(2,2,13,verbose);
@@ -295,6 +1390,106 @@ int main() {
   transformDeltas(4,1,9);
   transformDeltas(4,2,13);
   cout << "deltas ok " << endl;
+  checkTuner(1,100000);
+  checkTuner(2,1000000);
+  cout << "tuner ok " << endl;
+  checkStatistics(4,1,1025);
+  checkStatistics(8,2,4097);
+  cout << "statistics ok " << endl;
+  checkEngines(2,1,65);
+  checkEngines(4,2,161);
+  cout << "engines ok " << endl;
+  checkQueryCache(2,1,1025);
+  checkQueryCache(4,2,4097);
+  cout << "query cache ok " << endl;
+  checkProgressiveQueries(2,1,4097);
+  checkProgressiveQueries(4,2,16385);
+  checkProgressiveQueries(8,2,32769);
+  cout << "progressive queries ok " << endl;
+  checkMinMaxPyramid(2,65);
+  checkMinMaxPyramid(3,100);
+  checkMinMaxPyramid(8,257);
+  cout << "min/max pyramid ok " << endl;
+  checkPiecewiseQueries(2,1,4097);
+  checkPiecewiseQueries(4,2,16385);
+  checkPiecewiseQueries(8,2,32769);
+  checkPiecewiseQueries(128,2,2*128*128+1);
+  cout << "piecewise queries ok " << endl;
+  checkSlidingMoments(2,1,1025);
+  checkSlidingMoments(4,2,4097);
+  cout << "sliding moments ok " << endl;
+  checkPolynomialFit(2,1,1025);
+  checkPolynomialFit(4,2,4097);
+  checkPolynomialFit(16,2,16*16*16+1);
+  cout << "polynomial fits ok " << endl;
+  checkInPlaceBuffer(2,1,1025);
+  checkInPlaceBuffer(4,2,4097);
+  checkInPlaceBuffer(16,2,16*16*16*3+1);
+  cout << "in-place buffers ok " << endl;
+  checkCoefficientTables(2,1);
+  checkCoefficientTables(4,2);
+  checkCoefficientTables(16,8);
+  checkCoefficientTables(128,2);
+  cout << "coefficient tables ok " << endl;
+  checkMultiSeries(2,1,257,1);
+  checkMultiSeries(4,2,1025,11);
+  checkMultiSeries(8,2,4097,16);
+  cout << "multi-series ok " << endl;
+  checkBufferArena(2,1,100);
+  checkBufferArena(4,2,50);
+  checkBufferArena(16,2,20);
+  cout << "buffer arena ok " << endl;
+  checkLargeIndexes(2048,2);
+  checkLargeIndexes(4096,1);
+  cout << "large indexes ok " << endl;
+  checkStripedArray(1,1024,4097);
+  checkStripedArray(3,1024,16385);
+  checkStripedArray(4,2048,65537);
+  cout << "striped arrays ok " << endl;
+  checkStreamBuilder(2,1,1025);
+  checkStreamBuilder(2,2,1025);
+  checkStreamBuilder(4,2,4097);
+  checkStreamBuilder(3,3,3*3*3*3*3*3*3+1);
+  checkStreamBuilder(16,2,16*16*16*3+1);
+  cout << "stream builder ok " << endl;
+  checkCheckpoints(2,1,(1<<20)+1);
+  checkCheckpoints(16,2,16*16*16*16+1);
+  cout << "checkpoints ok " << endl;
+  checkExecutor(1,false);
+  checkExecutor(4,true);
+  checkExecutor(0,true);
+  cout << "executor ok " << endl;
+  checkInterleavedQueries(2,1,4097);
+  checkInterleavedQueries(4,2,16385);
+  checkInterleavedQueries(16,2,16*16*16*5+1);
+  checkInterleavedQueries(128,2,2*128*128+1);
+  cout << "interleaved queries ok " << endl;
+  checkRangeUpdate(2,1,4097);
+  checkRangeUpdate(2,2,4097);
+  checkRangeUpdate(4,2,16385);
+  checkRangeUpdate(3,3,3*3*3*3*3*3*3*3+1);
+  checkRangeUpdate(16,2,16*16*16*5+1);
+  cout << "range updates ok " << endl;
+  checkBufferAlgebra(2,1,4097,0);
+  checkBufferAlgebra(4,2,16385,3);
+  checkBufferAlgebra(16,2,16*16*16*16+1,2);
+  cout << "buffer algebra ok " << endl;
+  checkRebase(2,1,2,4*4*4*4*4+1);
+  checkRebase(4,1,3,64*64*4+1);
+  checkRebase(2,2,2,4*4*4*4*4+1);
+  checkRebase(4,2,2,16*16*16+1);
+  checkRebase(3,3,2,9*9*9*9+1);
+  checkRebase(16,2,2,256*256*2+1);
+  cout << "rebasing ok " << endl;
+  checkSparse(2,1,(1<<16)+1,200);
+  checkSparse(2,2,(1<<16)+1,50);
+  checkSparse(4,2,(1<<18)+1,1000);
+  checkSparse(3,3,3*3*3*3*3*3*3*3*3+1,30);
+  checkSparse(16,2,16*16*16*16+1,500);
+  cout << "sparse data ok " << endl;
+  checkCachedArray(2,1,64*1024+1);
+  checkCachedArray(16,2,16*16*16*16+1);
+  cout << "cached external arrays ok " << endl;
   cout << "If you made it that far, the code should be mostly bug free." << endl;
 }
 
@@ -42,6 +42,9 @@ class VirtualArray {
     VirtualArray(uint64 size) : mArraySize(size), mF(){
     }
 
+    VirtualArray(uint64 size, const Functor& F) : mArraySize(size), mF(F){
+    }
+
     virtual ~VirtualArray(){
     }
     const DataType  operator[](const uint64& pos) const {return mF(pos);}
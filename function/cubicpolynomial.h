@@ -18,6 +18,8 @@
 
 using namespace std;
 
+typedef long long int64;
+
 
 
 
@@ -27,7 +29,7 @@ using namespace std;
  * This is just an object-function representing the polynomial
  * a0 + a1 * x + a2 * x**2 + a3 x **3
  */
-class CubicPolynomial : public unary_function<int,float>  {
+class CubicPolynomial : public unary_function<int64,float>  {
     public:
       
       CubicPolynomial(float a0, float a1, float a2, float a3):	mA0(a0),mA1(a1),mA2(a2),mA3(a3){}
@@ -54,7 +56,7 @@ class CubicPolynomial : public unary_function<int,float>  {
         return *this;
       }
       
-      inline float operator()(const int& x) const { 
+      inline float operator()(const int64& x) const { 
         // somewhat optimized
         float answer = mA0;
         float poly = x;
@@ -70,12 +72,15 @@ class CubicPolynomial : public unary_function<int,float>  {
 };
 
 
-class RangedFunction : public  unary_function<int,float> {
+/*
+ * A function of the (64-bit) index over the range Start <= x < End, and zero elsewhere.
+ */
+class RangedFunction : public  unary_function<int64,float> {
   public:
-    RangedFunction(int Start, int End) : mStart(Start), mEnd(End) {}
-    virtual float operator()(const int& x) const = 0;
+    RangedFunction(int64 Start, int64 End) : mStart(Start), mEnd(End) {}
+    virtual float operator()(const int64& x) const = 0;
     virtual ~RangedFunction() {}
-    int mStart, mEnd;			
+    int64 mStart, mEnd;			
 };
 
 /*
@@ -85,10 +90,10 @@ class RangedFunction : public  unary_function<int,float> {
  */
 class RangedCubicPolynomial : public CubicPolynomial, public RangedFunction  {
   public:
-      RangedCubicPolynomial(float a0, float a1, float a2, float a3, int Start, int End): 
+      RangedCubicPolynomial(float a0, float a1, float a2, float a3, int64 Start, int64 End): 
         CubicPolynomial(a0,a1,a2,a3), RangedFunction(Start,End) {}
 
-      RangedCubicPolynomial(const CubicPolynomial& CP, int Start, int End):
+      RangedCubicPolynomial(const CubicPolynomial& CP, int64 Start, int64 End):
         CubicPolynomial(CP), RangedFunction(Start,End) {}
 
       RangedCubicPolynomial(const RangedCubicPolynomial& CP):
@@ -96,11 +101,11 @@ class RangedCubicPolynomial : public CubicPolynomial, public RangedFunction  {
 
       virtual ~RangedCubicPolynomial() {}
       
-      inline float operator()(const int& x) const {
+      inline float operator()(const int64& x) const {
         if((x < mStart) || (x >= mEnd)) return 0.0f;	
         return CubicPolynomial::operator()(x);
       }
-      static RangedCubicPolynomial monome(const int degree,const int start, const int end) {
+      static RangedCubicPolynomial monome(const int degree,const int64 start, const int64 end) {
         // convenience method!!!
         return RangedCubicPolynomial(CubicPolynomial::monome(degree),start,end);
       }
@@ -0,0 +1,97 @@
+// Lemur OLAP library (c) 2003 National Research Council of Canada by Daniel Lemire, and Owen Kaser
+ /**
+ *  This program is free software; you can
+ *  redistribute it and/or modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation (version 2). This
+ *  program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ *  details. You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef PIECEWISEPOLYNOMIAL_H
+#define PIECEWISEPOLYNOMIAL_H
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "cubicpolynomial.h"
+
+using namespace std;
+
+/*
+ * This is an object-function representing a piecewise cubic polynomial:
+ * pieces[k] over breakpoints[k] <= x < breakpoints[k+1], and zero
+ * elsewhere (x < Start, x >= End). Use it for kernels (trapezoids, splines)
+ * and unions of disjoint ranges (zero pieces in between), e.g.
+ *
+ *  PiecewisePolynomial trapezoid(100);
+ *  trapezoid.append(CubicPolynomial(-100,1,0,0), 110); // ramp up
+ *  trapezoid.append(CubicPolynomial(10,0,0,0), 190);   // plateau
+ *  trapezoid.append(CubicPolynomial(200,-1,0,0), 200); // ramp down
+ *
+ * OlaBuffer::query evaluates it in one pass over the levels (see olabuffer.h).
+ */
+class PiecewisePolynomial : public RangedFunction {
+  public:
+    PiecewisePolynomial(int64 Start) : RangedFunction(Start, Start), mBreakpoints(1, Start) {}
+
+    PiecewisePolynomial(const PiecewisePolynomial& PP) :
+      RangedFunction(PP.mStart, PP.mEnd), mBreakpoints(PP.mBreakpoints), mPieces(PP.mPieces) {}
+
+    virtual ~PiecewisePolynomial() {}
+
+    // adds the piece [mEnd, End)
+    void append(const CubicPolynomial& piece, int64 End) {
+      assert(End >= mEnd);
+      if(End == mEnd) return;
+      mPieces.push_back(piece);
+      mBreakpoints.push_back(End);
+      mEnd = End;
+    }
+
+    inline float operator()(const int64& x) const {
+      if((x < mStart) || (x >= mEnd)) return 0.0f;
+      const int k = upper_bound(mBreakpoints.begin(), mBreakpoints.end(), x) - mBreakpoints.begin() - 1;
+      return mPieces[k](x);
+    }
+
+    int numberOfPieces() const { return mPieces.size(); }
+    const CubicPolynomial& piece(const int k) const { return mPieces[k]; }
+    const vector<int64>& breakpoints() const { return mBreakpoints; }
+
+    /*
+     * The breakpoints where the function actually changes: mStart and mEnd
+     * unless the piece next to them is zero, and the interior breakpoints
+     * between two different pieces. Only these need boundary windows in a query.
+     */
+    vector<int64> discontinuities() const {
+      vector<int64> answer;
+      const CubicPolynomial zero(0,0,0,0);
+      for(uint k = 0; k < mBreakpoints.size(); ++k) {
+        const CubicPolynomial & left = (k == 0) ? zero : mPieces[k - 1];
+        const CubicPolynomial & right = (k == mPieces.size()) ? zero : mPieces[k];
+        if(!same(left, right)) answer.push_back(mBreakpoints[k]);
+      }
+      return answer;
+    }
+
+    PiecewisePolynomial& operator=(const PiecewisePolynomial& rhs) {
+      mStart = rhs.mStart;
+      mEnd = rhs.mEnd;
+      mBreakpoints = rhs.mBreakpoints;
+      mPieces = rhs.mPieces;
+      return *this;
+    }
+
+  protected:
+    static inline bool same(const CubicPolynomial& p, const CubicPolynomial& q) {
+      return (p.mA0 == q.mA0) && (p.mA1 == q.mA1) && (p.mA2 == q.mA2) && (p.mA3 == q.mA3);
+    }
+
+    vector<int64> mBreakpoints; // one more than the pieces
+    vector<CubicPolynomial> mPieces;
+};
+
+#endif